@@ -0,0 +1,44 @@
+#ifndef BATCH_h
+#define BATCH_h
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Offline solving of many cubes. Every input line holds either a scramble in
+// move notation or a state as one color letter per sticker (see parse_state).
+// Lines are shared out to a pool of workers, each reusing one cube and solver
+// for all of its jobs, and solutions are written one per line in input order
+// as soon as they are ready.
+
+#define BATCH_HISTOGRAM_BINS 16
+
+typedef struct {
+    uint32_t sides;
+    uint32_t thread_count; // 0 uses every online processor
+} BatchOptions;
+
+typedef struct {
+    uint32_t solved;
+    uint32_t failed;
+    uint32_t threads;
+    double seconds;
+
+    // time each job spent with its worker, from reading the line to having
+    // the solution
+    double p50_ms;
+    double p99_ms;
+    double max_ms;
+
+    uint32_t min_moves;
+    uint32_t max_moves;
+    uint32_t bin_width;
+    uint32_t histogram[BATCH_HISTOGRAM_BINS];
+} BatchStats;
+
+int run_batch(FILE *in, FILE *out, BatchOptions options, BatchStats *p_stats);
+void write_batch_stats(FILE *file, BatchStats const *stats);
+
+// `cube batch <sides> [threads]`, solving stdin to stdout
+int batch_main(int argc, char **argv);
+
+#endif // BATCH_h
@@ -0,0 +1,39 @@
+#ifndef CAPTURE_h
+#define CAPTURE_h
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Writes captured frames on a thread of its own, so that the one drawing never
+// waits on the disk. Frames are handed over by the slot their pixels live in,
+// and the slot stays busy until they are written. Each frame is a binary PPM,
+// so a capture is a stream of them that ffmpeg reads with -f image2pipe
+
+#define CAPTURE_MAX_SLOTS 8
+
+typedef struct capture_writer CaptureWriter;
+
+typedef struct {
+    // rows of RGBA bytes, the bottom row first as glReadPixels gives them
+    uint8_t const *pixels;
+    uint32_t width;
+    uint32_t height;
+
+    FILE *file;
+    int close_file; // once the frame is in it, for single screenshots
+} CaptureFrame;
+
+CaptureWriter *new_capture_writer(void);
+
+// waits for everything queued to be written
+void free_capture_writer(CaptureWriter *writer);
+
+void submit_capture_frame(CaptureWriter *writer, uint32_t slot,
+                          CaptureFrame frame);
+int is_capture_slot_busy(CaptureWriter *writer, uint32_t slot);
+
+// Waits for everything queued to be written, returns -1 if any of it couldn't
+// be since the last call
+int finish_capture_frames(CaptureWriter *writer);
+
+#endif // CAPTURE_h
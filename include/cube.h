@@ -2,6 +2,7 @@
 #define CUBE_h
 
 #include <stdint.h>
+#include <stdio.h>
 
 typedef enum {
     FC_White,
@@ -16,14 +17,64 @@ typedef enum {
 
 typedef struct cube Cube;
 
+// An inclusive range of rows within a face, empty when first > last
+typedef struct {
+    uint32_t first;
+    uint32_t last;
+} RowRange;
+
 Cube *new_cube(uint32_t sides);
 uint32_t get_side_count(Cube *cube);
 void free_cube(Cube *cube);
+void copy_cube(Cube *dst, Cube *src);
 void rotate_front(Cube *cube, uint32_t depth, int clockwise);
 void set_facing_side(Cube *cube, FaceColor facing_side);
+FaceColor get_facing_side(Cube *cube);
 void set_orientation(Cube *cube, int orientation);
 void checkerboard(Cube *cube);
 
+// A single layer turn. `depth` counts layers in from `face`, and `turns` is the
+// number of clockwise quarter turns seen from `face` (3 is counter-clockwise)
+typedef struct {
+    uint8_t face; // FaceColor
+    uint8_t turns;
+    uint16_t depth;
+} Move;
+
+void apply_move(Cube *cube, Move move);
+void apply_moves(Cube *cube, Move const *moves, uint32_t count);
+Move invert_move(Move move);
+int parse_moves(char const *notation, uint32_t sides, Move *moves,
+                uint32_t max_moves, uint32_t *p_count);
+void write_moves(FILE *file, Move const *moves, uint32_t count);
+void print_moves(Move const *moves, uint32_t count);
+
+// Stickers are stored face by face, row-major within a face, so the sticker at
+// (face, row, col) is squares[(face * sides + row) * sides + col]
+FaceColor const *get_squares(Cube *cube);
+int is_solved(Cube *cube);
+// Reads the stickers in storage order as color letters (W R B O G Y), ignoring
+// whitespace. Returns -1 unless there is exactly one letter per sticker
+int parse_state(char const *text, Cube *cube);
+
+// Moves the sticker at from[i] to to[i], for applying the known net effect of a
+// longer move sequence without turning every layer it touches
+void permute_stickers(Cube *cube, uint32_t const *from, uint32_t const *to,
+                      uint32_t count);
+
+// The rows of each face changed since the last clear_dirty_rows, so that a
+// copy of the cube elsewhere only needs those rows redone. A new or copied
+// cube starts with every row dirty
+void get_dirty_rows(Cube *cube, RowRange rows[FC_Count]);
+void clear_dirty_rows(Cube *cube);
+
+// The layers a sticker's cubie sits in, counted in from the white, red and blue
+// faces respectively
+void get_sticker_layers(uint32_t sides, FaceColor face, uint32_t row,
+                        uint32_t col, uint32_t layers[3]);
+int get_sticker_at(uint32_t sides, FaceColor face, uint32_t const layers[3],
+                   uint32_t *p_row, uint32_t *p_col);
+
 typedef void (*WriterFunction)(void *, FaceColor);
 typedef struct {
     uint32_t item_size;
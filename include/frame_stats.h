@@ -0,0 +1,40 @@
+#ifndef FRAME_STATS_h
+#define FRAME_STATS_h
+
+#include <stdint.h>
+#include <stdio.h>
+
+// How long the last FRAME_STATS_WINDOW frames took. Their times are also kept
+// as a histogram of FRAME_STATS_BIN_US wide bins, so percentiles cost the same
+// however long the window is. The last bin holds every slower frame too
+
+#define FRAME_STATS_WINDOW 600
+#define FRAME_STATS_BIN_US 100
+#define FRAME_STATS_BINS 1000
+
+typedef struct {
+    // a frame slower than this by half a frame missed its deadline, it stayed
+    // on screen for at least one refresh too many
+    double target_seconds;
+
+    uint32_t times_us[FRAME_STATS_WINDOW];
+    uint32_t next;
+    uint32_t count;
+    uint32_t missed; // of the frames in the window
+
+    uint64_t total_frames;
+    uint64_t total_missed;
+
+    uint32_t bins[FRAME_STATS_BINS];
+} FrameStats;
+
+void init_frame_stats(FrameStats *stats, double target_seconds);
+void record_frame(FrameStats *stats, double seconds);
+
+// The time, in seconds, that `percent` of the frames in the window were no
+// slower than, to the bin
+double frame_percentile(FrameStats const *stats, uint32_t percent);
+
+void write_frame_stats(FILE *file, FrameStats const *stats);
+
+#endif // FRAME_STATS_h
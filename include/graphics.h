@@ -4,9 +4,12 @@
 #include <GL/glew.h>
 #include <SDL2/SDL.h>
 
+#include "capture.h"
 #include "cube.h"
+#include "frame_stats.h"
 #include "memory.h"
 #include "my_math.h"
+#include "solver.h"
 
 // TODO: figure out how I want to deal with distances, pixels to meters, etc.
 #define CAMERA_SCREEN_DIST 5.0f
@@ -16,6 +19,9 @@ typedef struct {
     double phi;
 } Camera;
 
+// Everything about the camera for one frame, worked out once in update and
+// used by picking, dragging and drawing alike. The cube sits at the origin and
+// the camera at `eye`
 typedef struct {
     V3 x_dir;
     V3 y_dir;
@@ -24,6 +30,12 @@ typedef struct {
     V2 screen_x_dir;
     V2 screen_y_dir;
     V2 screen_z_dir;
+
+    V3 eye;
+    float screen_cube_ratio;
+
+    M4 view_projection;
+    M4 inverse_view_projection;
 } BasisInformation;
 
 typedef struct {
@@ -37,6 +49,31 @@ typedef struct {
     uint32_t screen_y;
 } ClickInformation;
 
+// Faces draws one quad per face sampling the net texture, Stickers draws an
+// instance per sticker colored from a copy of the cube's squares
+typedef enum {
+    RP_Faces,
+    RP_Stickers,
+
+    RP_Count,
+} RenderPath;
+
+// Turns waiting to be shown. The first is the one animating, and it is only
+// applied to the cube once it has finished turning
+#define TURN_QUEUE_SIZE 256
+typedef struct {
+    Move moves[TURN_QUEUE_SIZE];
+    uint32_t first;
+    uint32_t count;
+    double progress; // of the first move, from 0 to 1
+} TurnQueue;
+
+typedef enum {
+    SS_Idle,
+    SS_Solving,
+    SS_Playing,
+} SolveStatus;
+
 typedef struct {
     int theta_rot_dir;
     int phi_rot_dir;
@@ -49,8 +86,22 @@ typedef struct {
         uint32_t mouse_held : 1;
         uint32_t mouse_clicked_cube : 1;
         uint32_t cube_intersection_found : 1;
+        uint32_t cube_turned : 1;
+        uint32_t needs_redraw : 1;
+        uint32_t dynamic_resolution : 1;
+        uint32_t recording : 1;
+        uint32_t screenshot_requested : 1;
     };
 
+    RenderPath render_path;
+    TurnQueue turns;
+
+    // the solver runs a slice per frame, then its moves are played back
+    SolveStatus solve_status;
+    int solve_percent;
+    uint32_t solve_index;
+    double solve_clock;
+
     uint32_t screen_mouse_x;
     uint32_t screen_mouse_y;
 
@@ -77,6 +128,14 @@ typedef struct {
         uint32_t window_resized : 1;
         uint32_t toggle_mouse_click : 1;
         uint32_t checkerboard : 1;
+        uint32_t toggle_solve : 1;
+        uint32_t toggle_render_path : 1;
+        uint32_t window_exposed : 1;
+        uint32_t dump_frame_stats : 1;
+        uint32_t toggle_dynamic_resolution : 1;
+        uint32_t toggle_recording : 1;
+        uint32_t take_screenshot : 1;
+        uint32_t after_wait : 1;
     };
 
     int camera_rho_dir;
@@ -93,42 +152,226 @@ typedef struct {
     uint32_t window_height;
 
     double delta_time;
-    Uint32 ticks;
+    Uint64 counter; // SDL_GetPerformanceCounter at the start of the frame
 } StateUpdate;
 
-typedef struct {
-    V3 position;
-    float face_num;
-} VertexInformation;
+// two triangles per face as a strip, made in the vertex shader
+#define FACE_VERTICES 4
 
-typedef struct {
-    float intersecting;
-} VertexAttributes;
+// squares drawn behind a turning layer, after the faces
+#define TURN_CAPS 4
+
+// pixel buffers the texture updates cycle through, so that writing one never
+// waits on the GPU still reading the last
+#define TEXTURE_PBO_COUNT 3
+
+// Each of them holds this many stickers at most, uploads bigger than that are
+// sent in rounds
+#define TEXTURE_PBO_BYTES (1u << 22)
+
+// texture units, matching the bindings in the shaders
+#define CUBE_TEXTURE_UNIT 0
+#define STICKER_COLOR_UNIT 1
+#define SUMMARY_TEXTURE_UNIT 2
+#define CUBE_TRANSFORM_UNIT 3
+
+// Cubes with more stickers to a side than this also keep a summary of each
+// face at this size, which is drawn once stickers are smaller than
+// LOD_STICKER_PIXELS on screen
+#define SUMMARY_SIZE 512
+#define LOD_STICKER_PIXELS 1.0f
+
+// a bit for each face, in FaceColor order
+#define ALL_FACES ((1u << FC_Count) - 1)
+
+// the textures hold FaceColors, which index the palette
+#define PALETTE_SIZE FC_Count
 
 typedef struct {
-    GLuint vao, vbo[2], ebo, texture;
+    unsigned char r, g, b;
+} Color;
 
-    VertexInformation *info;
-    uint32_t vertex_count;
+// One upload into the face texture, from `offset` in the pixel buffer
+typedef struct {
+    uint32_t layer;
+    uint32_t x, y;
+    uint32_t width, height;
+    size_t offset;
+} TileRegion;
 
-    int *indices;
-    uint32_t index_count;
+typedef struct {
+    GLuint vao, texture;
+    GLuint pbo[TEXTURE_PBO_COUNT];
+    uint32_t next_pbo;
+    size_t pbo_size;
+
+    // The texture is an array of square tiles, `tiles_per_side` by
+    // `tiles_per_side` of them for each face, holding a face's stickers in the
+    // order they are stored. A face small enough gets one tile of its own size
+    uint32_t tile_size;
+    uint32_t tiles_per_side;
+    TileRegion *regions;
+
+    // the sticker colors, as bytes, and the buffer texture they go to. The
+    // staging is NULL when they don't fit in one
+    GLuint color_buffer, color_texture;
+    uint8_t *color_staging;
+
+    // Texel (y, x) of a face's summary is how much of each color its block of
+    // stickers has, the first four colors in one layer and the last two in the
+    // next. The counts are kept up to date from the stickers as last seen
+    GLuint summary_texture;
+    uint32_t summary_size; // 0 when the cube is too small to need one
+    uint32_t *summary_counts;
+    uint8_t *summary_seen;
+    uint8_t *summary_texels;
+
+    // rows each copy of the cube has yet to catch up on
+    RowRange texture_dirty[FC_Count];
+    RowRange colors_dirty[FC_Count];
+    RowRange summary_dirty[FC_Count];
 
     Cube *cube;
 } GraphicsCube;
 
+// Cubes turning at random around the one being played with, laid out in a
+// grid facing the starting camera. They are all drawn by the sticker path
+// together: a face's instances run through the stickers of each cube in turn,
+// and find where their cube is and its colors by instance. Cube 0 is the one
+// being played with, at the origin and not moved
+#define SCENE_SPACING 3.0f
+#define SCENE_TURNS_PER_SEC 30.0
+
+typedef struct {
+    uint32_t cube_count;
+    Cube **cubes; // the first is the GraphicsCube's own
+    float radius; // of a ball around the origin that holds every cube
+
+    // a vec4 for each cube, its offset and then its scale
+    GLuint transform_buffer, transform_texture;
+
+    double turn_clock;
+} Scene;
+
+// With dynamic resolution on, frames are drawn to an offscreen target `scale`
+// times the window's size and stretched over the window. The scale is chosen
+// from how long the GPU took for the last GPU_TIME_SAMPLES frames, so that it
+// keeps within GPU_BUDGET_SECONDS
+#define MIN_RENDER_SCALE 0.25f
+#define RENDER_SCALE_STEP 0.05f
+#define GPU_BUDGET_SECONDS (0.8 / 60.0)
+#define GPU_GROW_HEADROOM 0.8
+#define GPU_TIME_SAMPLES 30
+
+// timer queries in flight, each read back once the GPU has finished with it
+#define GPU_TIMER_COUNT 4
+
+typedef struct {
+    GLuint framebuffer, color, depth;
+    uint32_t width, height; // of what the target was last made for
+
+    float scale;
+    double gpu_seconds[GPU_TIME_SAMPLES]; // of frames drawn at this scale
+    uint32_t samples;
+
+    GLuint queries[GPU_TIMER_COUNT];
+    uint32_t next_query;
+    uint32_t pending;
+    uint32_t stale; // pending queries that were timing the last scale
+} ScaledTarget;
+
+// Frames are captured by reading them into a ring of pixel buffers. The read
+// runs on the GPU after the frame is drawn, and the buffer is mapped for the
+// writer once its fence has passed, a few frames later. A frame whose slot is
+// still busy is dropped rather than waited for
+#define CAPTURE_SLOT_COUNT 4
+#define RECORDING_NAME_FORMAT "capture-%ld.ppm"
+#define SCREENSHOT_NAME_FORMAT "screenshot-%ld-%u.ppm"
+
+typedef enum {
+    CS_Free,
+    CS_Reading,
+    CS_Writing, // mapped, until the writer is done with it
+} CaptureSlotState;
+
+typedef struct {
+    GLuint pbo;
+    size_t size;
+    GLsync fence;
+    CaptureSlotState state;
+    CaptureFrame frame;
+} CaptureSlot;
+
+typedef struct {
+    CaptureWriter *writer; // NULL until something is first captured
+    CaptureSlot slots[CAPTURE_SLOT_COUNT];
+    uint32_t next_slot; // also the oldest
+
+    FILE *recording;
+    uint32_t captured;
+    uint32_t dropped;
+    uint32_t screenshots;
+} Capture;
+
+// The ViewInformation block in the shaders, laid out by std140 rules: the
+// matrix is four vec4 columns, and the vec3 starts on 16 bytes with room for a
+// float behind it
+#define VIEW_UNIFORM_BINDING 0
+typedef struct {
+    M4 view_projection;
+    V3 hover_point;
+    float side_count;
+    int32_t hover_face; // -1 when nothing is hovered
+    int32_t use_summary;
+    int32_t tile_size;
+    float padding;
+    V3 turn_axis; // the turning face's normal
+    float turn_angle;
+    int32_t turn_depth; // -1 when nothing is turning
+    float padding2[3];
+} ViewUniforms;
+
+// The Palette block, one vec4 per entry under std140. It is written once, and
+// again only if the colors change
+#define PALETTE_UNIFORM_BINDING 1
+typedef struct {
+    float colors[PALETTE_SIZE][4];
+} PaletteUniforms;
+
 typedef struct {
     SDL_Window *window;
-    Uint32 last_ticks;
+    Uint64 last_counter;
+    FrameStats frame_stats;
 
     SDL_GLContext *gl_context;
     GLuint gl_program;
+    GLuint sticker_program;
+    GLuint view_ubo;
+    GLuint palette_ubo;
     GraphicsCube cube;
+    Scene scene;
+    ScaledTarget scaled;
+    ScaledTarget offscreen; // drawn to instead of the window when headless
+    Capture capture;
+
+    Solver *solver;
+    Solution solution;
 
     Arena *arena;
     State state;
 } Application;
 
-int graphics_main(void);
+// `cube_size` is only limited by memory, large faces are split over tiles.
+// With a `cube_count` over 1 the rest turn at random around the first, and
+// every cube's stickers have to fit in one buffer texture
+int graphics_main(uint32_t cube_size, uint32_t cube_count);
+
+// `cube render <sides> <cubes> <frames> <width> <height> [out.ppm]` draws
+// frames with no window, orbiting the camera around the scene, and prints how
+// long they took. Every frame is read back, and written to `out.ppm` as a
+// stream of PPMs when it is given
+#define HEADLESS_ORBIT_STEP (PI / 90.0)
+
+int render_main(int argc, char **argv);
 
 #endif // GRAPHICS_h
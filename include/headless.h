@@ -0,0 +1,15 @@
+#ifndef HEADLESS_h
+#define HEADLESS_h
+
+// An OpenGL 4.2 core context with no window or surface behind it, through
+// EGL, for machines without a display. Mesa's surfaceless platform is used
+// when there is one, which llvmpipe renders on with no GPU at all. Whatever
+// is drawn goes to framebuffers of its own, there is no default one
+
+typedef struct headless_context HeadlessContext;
+
+// The context is current once this returns, NULL if one couldn't be made
+HeadlessContext *new_headless_context(void);
+void free_headless_context(HeadlessContext *context);
+
+#endif // HEADLESS_h
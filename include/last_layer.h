@@ -0,0 +1,45 @@
+#ifndef LAST_LAYER_h
+#define LAST_LAYER_h
+
+#include <stdint.h>
+
+#include "cube.h"
+
+// Last layer recognition for 3x3 cubes solved with white on the bottom. Every
+// reachable yellow layer state has a direct index computed from its 20
+// stickers, so classifying a cube is a handful of table lookups.
+
+#define LL_NO_CASE 0xFFFF
+
+typedef struct ll_table LLTable;
+
+typedef struct {
+    uint32_t state;
+    // cases are counted up to the U turns before and after the algorithm
+    uint16_t ll_case;
+    uint16_t oll_case;
+    uint16_t pll_case;  // LL_NO_CASE unless the layer is oriented
+    uint16_t zbll_case; // LL_NO_CASE unless the edges are oriented
+
+    Move const *algorithm;
+    uint32_t algorithm_length;
+} LLClass;
+
+typedef struct {
+    uint32_t states;
+    uint32_t ll_cases;
+    uint32_t oll_cases;
+    uint32_t pll_cases;
+    uint32_t zbll_cases;
+    uint32_t stored_moves;
+} LLCaseCounts;
+
+LLTable *new_ll_table(void);
+void free_ll_table(LLTable *table);
+LLCaseCounts ll_case_counts(LLTable const *table);
+
+// Assumes the first two layers are solved; returns -1 if the yellow layer
+// does not hold a reachable last layer state
+int ll_classify(LLTable const *table, Cube *cube, LLClass *p_class);
+
+#endif // LAST_LAYER_h
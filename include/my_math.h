@@ -34,6 +34,11 @@ typedef struct {
     };
 } V3;
 
+// Column major, as GL takes it, so m[column][row]
+typedef struct {
+    float m[4][4];
+} M4;
+
 #define V3_of(x_v, y_v, z_v) ((V3){.x = (x_v), .y = (y_v), .z = (z_v)})
 
 #define CUBE_FACES 6
@@ -41,15 +46,16 @@ typedef struct {
 
 extern V3 const cube_vertices[8];
 extern int const face_indices[24];
+extern V3 const face_normals[CUBE_FACES];
 extern int const cube_vert_count;
 extern int const face_index_count;
 
 V3 point_to_face_center(V3 point);
 FaceColor get_cube_face(V3 point);
 
-#define VERTEX_COUNT_TO_TRIANGLE_COUNT(vertex_count) ((vertex_count) * 3 - 6)
-void expand_vertices_to_triangles(int const *indices, uint32_t index_count,
-                                  uint32_t indices_per_face, int *triangles);
+// a bit per face, in face_indices order, for the faces a camera at the origin
+// sees of a cube centered on `cube_center`
+uint32_t get_visible_faces(V3 cube_center);
 
 V3 add3(V3 lhs, V3 rhs);
 V3 scale3(V3 v, float c);
@@ -67,7 +73,20 @@ V3 as_unit(V3 v);
 V3 polar_to_rectangular(V3 v);
 
 V3 decompose(V3 target, V3 dir, V3 *perp);
-V3 complete_decomp(V3 target, V3 x, V3 y, V3 z);
 V3 compose(V3 target, V3 x_dir, V3 y_dir, V3 z_dir);
 
+M4 identity4(void);
+M4 mul4(M4 lhs, M4 rhs);
+// all zeros when `m` has no inverse
+M4 invert4(M4 m);
+// `w` divided out
+V3 transform_point(M4 m, V3 p);
+
+// views from `eye` with -z towards `target` and y along `up`, which should be
+// at right angles to it
+M4 look_at(V3 eye, V3 target, V3 up);
+// `focal` is the distance to a screen 2 high, the cotangent of half the
+// vertical field of view
+M4 perspective(float focal, float aspect, float near_z, float far_z);
+
 #endif
@@ -0,0 +1,59 @@
+#ifndef SOLVER_h
+#define SOLVER_h
+
+#include <stdint.h>
+
+#include "cube.h"
+
+// Reduction solver for cubes of any size. Parity is read off the stickers and
+// fixed first, then centers, edges and the 3x3 pieces are solved orbit by orbit
+// with commutators. A commutator's net effect is a 3-cycle that is known before
+// it is applied, so the solver writes it straight into its working copy instead
+// of turning every layer, which keeps the run time close to the sticker count.
+
+typedef enum {
+    SP_Parity,
+    SP_Centers,
+    SP_Edges,
+    SP_ThreeByThree,
+
+    SP_Count,
+} SolvePhase;
+
+typedef struct {
+    Move *moves;
+    uint32_t move_count;
+    uint32_t move_capacity;
+
+    uint32_t phase_moves[SP_Count];
+    double phase_seconds[SP_Count];
+} Solution;
+
+typedef enum {
+    SR_Running,
+    SR_Solved,
+    SR_Failed,
+} SolveResult;
+
+typedef struct solver Solver;
+
+Solver *new_solver(uint32_t sides);
+void free_solver(Solver *solver);
+
+// Leaves `cube` as it is and overwrites `solution`, growing its move buffer as
+// needed. Returns -1 if the cube does not hold a reachable state
+int solve_cube(Solver *solver, Cube *cube, Solution *solution);
+
+// The same solve in slices, for callers that cannot block: solve_begin copies
+// the cube, and each solve_step works for about `seconds` before returning,
+// carrying on where the last one stopped. The work is split into pieces of
+// about a millisecond, so a step overruns `seconds` by at most one of them
+void solve_begin(Solver *solver, Cube *cube, Solution *solution);
+SolveResult solve_step(Solver *solver, Solution *solution, double seconds);
+// The fraction of stickers in orbits solved so far
+float solve_progress(Solver const *solver);
+
+void free_solution(Solution *solution);
+void print_solution_stats(Solution const *solution);
+
+#endif // SOLVER_h
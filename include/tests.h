@@ -4,7 +4,16 @@
 #define TESTS                                                                  \
     X(test_1)                                                                  \
     X(test_2)                                                                  \
-    X(test_3)
+    X(test_3)                                                                  \
+    X(test_last_layer)                                                         \
+    X(test_solver)                                                             \
+    X(test_trans_table)                                                        \
+    X(test_batch)                                                              \
+    X(test_dirty_rows)                                                         \
+    X(test_visible_faces)                                                      \
+    X(test_matrices)                                                           \
+    X(test_frame_stats)                                                        \
+    X(test_capture_writer)
 
 #define X(t) void t(void);
 TESTS
@@ -0,0 +1,42 @@
+#ifndef TRANS_TABLE_h
+#define TRANS_TABLE_h
+
+#include <stdint.h>
+
+#include "cube.h"
+
+// Fixed size transposition table shared by search threads. Entries are single
+// 64-bit words updated with compare-and-swap, so probes and stores never take
+// a lock and a probe never sees half of someone else's store. A full bucket
+// keeps the entries searched deepest.
+
+typedef enum {
+    TB_None, // never stored, marks an empty slot
+    TB_Exact,
+    TB_Lower,
+    TB_Upper,
+} TTBound;
+
+typedef struct {
+    uint8_t depth;
+    uint8_t bound; // TTBound
+    uint16_t value;
+} TTEntry;
+
+typedef struct trans_table TransTable;
+
+// `bytes` is rounded down to a power of two number of buckets
+TransTable *new_trans_table(uint64_t bytes);
+void free_trans_table(TransTable *table);
+// Not safe to call while other threads use the table
+void clear_trans_table(TransTable *table);
+uint64_t trans_table_slots(TransTable const *table);
+
+// Both return 1 on success: tt_probe when `key` has an entry, tt_store when the
+// entry was kept rather than dropped for a deeper one
+int tt_probe(TransTable *table, uint64_t key, TTEntry *p_entry);
+int tt_store(TransTable *table, uint64_t key, TTEntry entry);
+
+uint64_t cube_fingerprint(Cube *cube);
+
+#endif // TRANS_TABLE_h
@@ -2,50 +2,149 @@
 
 in vec3 tex;
 in flat int face_num;
-in float mouse_in;
 
 out vec4 v4_frag_out;
 
-uniform sampler2D cube_texture;
+// a FaceColor per texel, each face split into square tiles in storage order
+layout (binding = 0) uniform usampler2DArray cube_texture;
 
-float get_color_scale(vec2 tex_coord);
-vec2 get_base(int fn);
+// how much of each color a block of stickers has, colors 0 to 3 in layer
+// 2 * face and 4 and 5 in the next, laid out in storage order
+layout (binding = 2) uniform sampler2DArray summary_texture;
+
+layout (std140, binding = 0) uniform ViewInformation
+{
+    mat4 view_projection;
+    vec3 hover_point;
+    float side_count;
+    int hover_face;
+    int use_summary;
+    int tile_size;
+    vec3 turn_axis;
+    float turn_angle;
+    int turn_depth;
+} view_information;
+
+// std140, laid out to match PaletteUniforms in graphics.h, one entry per
+// FaceColor
+layout (std140, binding = 1) uniform Palette
+{
+    vec4 colors[6];
+} palette;
+
+float get_color_scale(vec2 uv);
+bool is_hovered();
+uint get_color_index(vec2 uv, int fn);
+vec3 get_summary_color(vec2 uv, int fn);
+vec2 to_storage(vec2 rc, float n, int fn);
 vec2 get_v2_from_tex(vec3 t, int fn);
 vec2 hor_flip(vec2 i);
 vec2 ver_flip(vec2 i);
 
 #define PI 3.14159265
 
-uniform float side_count;
-
 void main()
 {
-  vec2 tex_coord = get_v2_from_tex(tex, face_num) / 4 + get_base(face_num);
-  float factor = get_color_scale(tex_coord);
-  factor *= 0.5f + 0.5f * (1.0f - floor(mouse_in));
+  vec2 uv = get_v2_from_tex(tex, face_num);
+
+  // stickers are smaller than pixels, so no borders and no hover either
+  if (view_information.use_summary != 0)
+  {
+    v4_frag_out = vec4(get_summary_color(uv, face_num), 1.0);
+    return;
+  }
 
-  v4_frag_out = vec4(factor * texture(cube_texture, tex_coord).xyz, 1.0);
+  float factor = get_color_scale(uv);
+  factor *= is_hovered() ? 0.5f : 1.0f;
+
+  uint index = min(get_color_index(uv, face_num), 5u);
+
+  v4_frag_out = vec4(factor * palette.colors[index].rgb, 1.0);
 }
 
-float get_color_scale(vec2 tex_coord) {
-  vec2 foo = fract(tex_coord * side_count * 4.0);
+float get_color_scale(vec2 uv) {
+  vec2 foo = fract(uv * view_information.side_count);
   vec2 bar = abs(1.0 - 2.0 * foo);
   float m = max(bar.x, bar.y);
 
   return m > 0.9 ? 0.0 : 1.0;
 }
 
-vec2 get_base(int fn)
+// the direction each face is read in the net, as net_dir in cube.c
+const int net_dirs[6] = int[6](2, 3, 2, 3, 0, 2);
+
+// finds the sticker under `uv` where the cube stores it, as get_at_rc in
+// cube.c, then the tile holding it
+uint get_color_index(vec2 uv, int fn)
 {
-  switch (fn)
+  int n = int(view_information.side_count);
+  int t = view_information.tile_size;
+  int tiles = (n + t - 1) / t;
+  ivec2 cell = ivec2(min(floor(uv * float(n)), vec2(float(n - 1))));
+  int r = cell.y;
+  int c = cell.x;
+  ivec2 rc;
+
+  switch (net_dirs[fn])
   {
-    case 0: return vec2(0.25f, 0.00f); // white
-    case 1: return vec2(0.25f, 0.25f); // red
-    case 2: return vec2(0.50f, 0.25f); // blue
-    case 3: return vec2(0.75f, 0.25f); // orange
-    case 4: return vec2(0.00f, 0.25f); // green
-    case 5: return vec2(0.25f, 0.50f); // yellow
+    case 0: rc = ivec2(r, c); break;
+    case 1: rc = ivec2(c, n - 1 - r); break;
+    case 2: rc = ivec2(n - 1 - r, n - 1 - c); break;
+    default: rc = ivec2(n - 1 - c, r); break;
   }
+
+  ivec2 tile = rc / t;
+  int layer = (fn * tiles + tile.x) * tiles + tile.y;
+  ivec2 in_tile = rc - tile * t;
+
+  return texelFetch(cube_texture, ivec3(in_tile.y, in_tile.x, layer), 0).r;
+}
+
+// the colors under `uv` mixed in the amounts its block of stickers has them
+vec3 get_summary_color(vec2 uv, int fn)
+{
+  float n = view_information.side_count;
+  float size = float(textureSize(summary_texture, 0).x);
+  vec2 rc = to_storage(uv.yx * n, n, fn);
+  ivec2 block = ivec2(min(floor(rc * size / n), vec2(size - 1.0f)));
+
+  vec4 first = texelFetch(summary_texture, ivec3(block.y, block.x, 2 * fn), 0);
+  vec4 last =
+    texelFetch(summary_texture, ivec3(block.y, block.x, 2 * fn + 1), 0);
+
+  return first.r * palette.colors[0].rgb + first.g * palette.colors[1].rgb +
+         first.b * palette.colors[2].rgb + first.a * palette.colors[3].rgb +
+         last.r * palette.colors[4].rgb + last.g * palette.colors[5].rgb;
+}
+
+// a row and column in the net to one in storage, as get_at_rc in cube.c does
+// for whole stickers
+vec2 to_storage(vec2 rc, float n, int fn)
+{
+  switch (net_dirs[fn])
+  {
+    case 0: return rc;
+    case 1: return vec2(rc.y, n - rc.x);
+    case 2: return vec2(n - rc.x, n - rc.y);
+    default: return vec2(n - rc.y, rc.x);
+  }
+}
+
+// whether this fragment is on the same sticker as the hovered point
+bool is_hovered()
+{
+  if (face_num != view_information.hover_face)
+  {
+    return false;
+  }
+
+  float n = view_information.side_count;
+  vec3 hover_tex = 0.5f * (view_information.hover_point + vec3(1.0f));
+  vec2 cell = min(floor(get_v2_from_tex(tex, face_num) * n), vec2(n - 1.0f));
+  vec2 hover_cell =
+    min(floor(get_v2_from_tex(hover_tex, face_num) * n), vec2(n - 1.0f));
+
+  return cell == hover_cell;
 }
 
 vec2 get_v2_from_tex(vec3 t, int fn)
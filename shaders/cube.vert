@@ -1,64 +1,52 @@
 #version 420 core
 
-layout (location = 0) in vec3 v3_pos;
-layout (location = 1) in float in_face_num;
-layout (location = 2) in float intersecting_triangle;
-
 out vec3 tex;
 out flat int face_num;
-out float mouse_in;
 
-struct ViewInformation
+// std140, laid out to match ViewUniforms in graphics.h
+layout (std140, binding = 0) uniform ViewInformation
 {
-    vec3 x_dir;
-    vec3 y_dir;
-    vec3 cube_center;
-
-    float screen_cube_ratio;
-    vec2 screen_dims;
-};
-
-uniform ViewInformation view_information;
-
-vec2 decompose(vec3 target, vec3 x_dir, vec3 y_dir);
+    mat4 view_projection;
+    vec3 hover_point;
+    float side_count;
+    int hover_face;
+    int use_summary;
+    int tile_size;
+    vec3 turn_axis;
+    float turn_angle;
+    int turn_depth;
+} view_information;
+
+// the corners of the cube and those of each face, as in my_math.c
+const vec3 cube_vertices[8] = vec3[8](
+    vec3(+1.0f, +1.0f, +1.0f),
+    vec3(-1.0f, +1.0f, +1.0f),
+    vec3(-1.0f, -1.0f, +1.0f),
+    vec3(+1.0f, -1.0f, +1.0f),
+    vec3(+1.0f, -1.0f, -1.0f),
+    vec3(-1.0f, -1.0f, -1.0f),
+    vec3(-1.0f, +1.0f, -1.0f),
+    vec3(+1.0f, +1.0f, -1.0f));
+
+const int face_indices[24] = int[24](
+    2, 3, 0, 1, // white
+    4, 7, 0, 3, // red
+    6, 1, 0, 7, // blue
+    5, 2, 1, 6, // orange
+    5, 4, 3, 2, // green
+    5, 6, 7, 4); // yellow
+
+// a face as a triangle strip, 1 2 0 then 0 2 3, the same two triangles as
+// splitting it from corner 0
+const int strip_corners[4] = int[4](1, 2, 0, 3);
 
 void main()
 {
-  vec3 cube_center = view_information.cube_center;
-
-  vec3 x_dir = view_information.x_dir;
-  vec3 y_dir = view_information.y_dir;
-
-  vec3 corner_pos = cube_center + v3_pos;
-
-  float cube_center_dist_sq = dot(cube_center, cube_center);
-  float numerator =
-    view_information.screen_cube_ratio * cube_center_dist_sq;
-  float corner_dot_center = dot(corner_pos, cube_center);
-  float scale_factor = numerator / corner_dot_center;
-
-  vec3 projected = scale_factor * corner_pos;
+  int face = gl_VertexID / 4;
+  vec3 v3_pos =
+    cube_vertices[face_indices[4 * face + strip_corners[gl_VertexID % 4]]];
 
-  vec2 components = decompose(
-          projected,
-          normalize(x_dir),
-          normalize(y_dir));
-
-  vec2 screen = components / normalize(view_information.screen_dims);
-
-  float depth = dot(projected, cube_center) / cube_center_dist_sq;
-  vec3 res = vec3(screen, depth);
-
-  gl_Position = vec4(res, 1.0f);
+  gl_Position = view_information.view_projection * vec4(v3_pos, 1.0f);
   tex = 0.5f * (v3_pos + vec3(1.0f));
-  face_num = int(in_face_num);
-  mouse_in = intersecting_triangle;
-}
-
-vec2 decompose(vec3 target, vec3 x_dir, vec3 y_dir)
-{
-    float dotted_x = dot(target, x_dir);
-    float dotted_y = dot(target, y_dir);
-
-    return vec2(dotted_x, dotted_y);
+  face_num = face;
 }
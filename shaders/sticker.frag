@@ -0,0 +1,26 @@
+#version 420 core
+
+in vec2 sticker_uv;
+in flat uint color_index;
+in flat int hovered;
+
+out vec4 v4_frag_out;
+
+// std140, laid out to match PaletteUniforms in graphics.h, indexed by
+// FaceColor
+layout (std140, binding = 1) uniform Palette
+{
+    vec4 colors[6];
+} palette;
+
+void main()
+{
+  vec2 bar = abs(1.0 - 2.0 * sticker_uv);
+  float m = max(bar.x, bar.y);
+  float factor = m > 0.9 ? 0.0 : 1.0;
+  factor *= hovered != 0 ? 0.5f : 1.0f;
+
+  // past the palette is the inside of the cube
+  vec3 color = color_index < 6u ? palette.colors[color_index].rgb : vec3(0.0);
+  v4_frag_out = vec4(factor * color, 1.0);
+}
@@ -0,0 +1,196 @@
+#version 420 core
+
+out vec2 sticker_uv;
+out flat uint color_index;
+out flat int hovered;
+
+// std140, laid out to match ViewUniforms in graphics.h
+layout (std140, binding = 0) uniform ViewInformation
+{
+    mat4 view_projection;
+    vec3 hover_point;
+    float side_count;
+    int hover_face;
+    int use_summary;
+    int tile_size;
+    vec3 turn_axis;
+    float turn_angle;
+    int turn_depth;
+} view_information;
+
+// a byte per sticker, laid out as the cube's squares, one cube after another
+layout (binding = 1) uniform usamplerBuffer sticker_colors;
+
+// where each cube is, its offset and then its scale
+layout (binding = 3) uniform samplerBuffer cube_transforms;
+
+// the corners of the cube and those of each face, as in my_math.c
+const vec3 cube_vertices[8] = vec3[8](
+    vec3(+1.0f, +1.0f, +1.0f),
+    vec3(-1.0f, +1.0f, +1.0f),
+    vec3(-1.0f, -1.0f, +1.0f),
+    vec3(+1.0f, -1.0f, +1.0f),
+    vec3(+1.0f, -1.0f, -1.0f),
+    vec3(-1.0f, -1.0f, -1.0f),
+    vec3(-1.0f, +1.0f, -1.0f),
+    vec3(+1.0f, +1.0f, -1.0f));
+
+const int face_indices[24] = int[24](
+    2, 3, 0, 1, // white
+    4, 7, 0, 3, // red
+    6, 1, 0, 7, // blue
+    5, 2, 1, 6, // orange
+    5, 4, 3, 2, // green
+    5, 6, 7, 4); // yellow
+
+// a quad as a triangle strip, corners 1 2 0 3, as steps along its edges
+const vec2 strip_steps[4] = vec2[4](
+    vec2(1.0f, 0.0f),
+    vec2(1.0f, 1.0f),
+    vec2(0.0f, 0.0f),
+    vec2(0.0f, 1.0f));
+
+// the direction each face is read in the net, as net_dir in cube.c
+const int net_dirs[6] = int[6](2, 3, 2, 3, 0, 2);
+
+vec2 get_v2_from_tex(vec3 t, int fn);
+ivec2 get_cell(vec3 pos, int fn);
+int get_storage_index(ivec2 cell, int fn);
+vec3 turn(vec3 pos);
+void make_cap(int cap);
+
+void main()
+{
+  int n = int(view_information.side_count);
+  int face = gl_VertexID / 4;
+  int cube = gl_InstanceID / (n * n);
+  int in_face = gl_InstanceID % (n * n);
+
+  // the vertices after the faces' are the insides the turning layer shows,
+  // only cube 0 turns that way and it sits at the origin
+  if (face >= 6)
+  {
+    make_cap(face - 6);
+    return;
+  }
+
+  // stickers step along the face's first and last edges, so their quads
+  // wind the same way as the face's
+  vec3 c0 = cube_vertices[face_indices[4 * face + 0]];
+  vec3 c1 = cube_vertices[face_indices[4 * face + 1]];
+  vec3 c3 = cube_vertices[face_indices[4 * face + 3]];
+  vec2 step = strip_steps[gl_VertexID % 4];
+  vec2 along = (vec2(in_face % n, in_face / n) + step) / float(n);
+  vec3 v3_pos = c0 + along.x * (c1 - c0) + along.y * (c3 - c0);
+
+  vec2 middle = (vec2(in_face % n, in_face / n) + 0.5f) / float(n);
+  vec3 middle_pos = c0 + middle.x * (c1 - c0) + middle.y * (c3 - c0);
+  ivec2 cell = get_cell(middle_pos, face);
+
+  // layers are counted in from the turning face, as a Move's depth
+  float from_face = 1.0f - dot(middle_pos, view_information.turn_axis);
+  int layer = clamp(int(floor(from_face * 0.5f * float(n))), 0, n - 1);
+  if (cube == 0 && layer == view_information.turn_depth)
+  {
+    v3_pos = turn(v3_pos);
+  }
+
+  vec4 transform = texelFetch(cube_transforms, cube);
+  v3_pos = transform.xyz + transform.w * v3_pos;
+
+  gl_Position = view_information.view_projection * vec4(v3_pos, 1.0f);
+
+  sticker_uv = step;
+  color_index = texelFetch(sticker_colors,
+                           get_storage_index(cell, face) + cube * 6 * n * n).r;
+  hovered = int(cube == 0 && face == view_information.hover_face &&
+                cell == get_cell(view_information.hover_point, face));
+}
+
+// rotates `pos` by the turn's angle about its axis
+vec3 turn(vec3 pos)
+{
+  vec3 axis = view_information.turn_axis;
+  float c = cos(view_information.turn_angle);
+  float s = sin(view_information.turn_angle);
+
+  return c * pos + s * cross(axis, pos) + (1.0f - c) * dot(axis, pos) * axis;
+}
+
+// A turning layer opens up the cube, so each of its sides gets a black square
+// facing out of it and one facing back from the rest of the cube. Caps 0 and 1
+// are on the side toward the turning face, 2 and 3 on the other, and the even
+// ones turn with the layer
+void make_cap(int cap)
+{
+  float n = view_information.side_count;
+  int depth = view_information.turn_depth;
+  vec3 axis = view_information.turn_axis;
+
+  // the cube's own faces cover the outsides of the first and last layers
+  bool shown = cap < 2 ? depth > 0 : depth < int(n) - 1;
+  float offset = 1.0f - 2.0f * float(cap < 2 ? depth : depth + 1) / n;
+  vec3 facing = cap == 0 || cap == 3 ? axis : -axis;
+
+  // two edges whose cross product is `facing`, so the strip is front facing
+  vec3 e = abs(facing);
+  vec3 u = dot(facing, e) > 0.0f ? e.yzx : e.zxy;
+  vec3 v = dot(facing, e) > 0.0f ? e.zxy : e.yzx;
+
+  vec2 step = strip_steps[gl_VertexID % 4];
+  vec3 v3_pos = offset * axis + (2.0f * step.x - 1.0f) * u +
+                (2.0f * step.y - 1.0f) * v;
+  if (cap % 2 == 0)
+  {
+    v3_pos = turn(v3_pos);
+  }
+
+  // a cap that isn't shown collapses to a point
+  gl_Position = shown ? view_information.view_projection * vec4(v3_pos, 1.0f)
+                      : vec4(0.0f);
+  sticker_uv = vec2(0.5f);
+  color_index = 6u;
+  hovered = 0;
+}
+
+// the column and row, in the net, of the sticker at `pos`
+ivec2 get_cell(vec3 pos, int fn)
+{
+  float n = view_information.side_count;
+  vec2 uv = get_v2_from_tex(0.5f * (pos + vec3(1.0f)), fn);
+
+  return ivec2(min(floor(uv * n), vec2(n - 1.0f)));
+}
+
+// where a net cell lives in the cube's squares, as get_at_rc in cube.c
+int get_storage_index(ivec2 cell, int fn)
+{
+  int n = int(view_information.side_count);
+  int r = cell.y;
+  int c = cell.x;
+  ivec2 rc;
+
+  switch (net_dirs[fn])
+  {
+    case 0: rc = ivec2(r, c); break;
+    case 1: rc = ivec2(c, n - 1 - r); break;
+    case 2: rc = ivec2(n - 1 - r, n - 1 - c); break;
+    default: rc = ivec2(n - 1 - c, r); break;
+  }
+
+  return (fn * n + rc.x) * n + rc.y;
+}
+
+// as in cube.frag
+vec2 get_v2_from_tex(vec3 t, int fn)
+{
+  switch (fn)
+  {
+    case 0: return t.yx;
+    case 1: return vec2(t.y, 1.0f - t.z);
+    case 2: return vec2(1.0f - t.x, 1.0f - t.z);
+    case 3: return vec2(1.0f - t.y, 1.0f - t.z);
+    case 4: return vec2(t.x, 1.0f - t.z);
+    default: return vec2(t.y, 1.0f - t.x);
+  }
+}
@@ -0,0 +1,463 @@
+#include "batch.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "cube.h"
+#include "solver.h"
+
+// jobs read ahead of the oldest one not yet written
+#define BATCH_WINDOW 256
+#define MAX_THREADS 256
+#define INITIAL_SCRAMBLE_MOVES 4096
+#define HISTOGRAM_BAR 50
+
+typedef enum {
+    JR_Solved,
+    JR_BadLine,
+    JR_Unsolvable,
+} JobResult;
+
+// Job slots are reused as the window moves, keeping their buffers
+typedef struct {
+    char *line;
+    size_t line_capacity;
+
+    JobResult result;
+    Move *moves;
+    uint32_t move_count;
+    uint32_t move_capacity;
+    double seconds;
+    int done;
+} Job;
+
+typedef struct {
+    uint32_t sides;
+    Cube *solved;
+    Job jobs[BATCH_WINDOW];
+
+    // job numbers, counted from the first line
+    uint64_t read_count;
+    uint64_t next_job;
+    uint64_t written;
+    int input_done;
+
+    FILE *in;
+    pthread_t reader;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t job_done;
+    pthread_cond_t window_room;
+} Batch;
+
+typedef struct {
+    Batch *batch;
+    pthread_t thread;
+
+    Cube *cube;
+    Solver *solver;
+    Solution solution;
+    Move *scramble;
+    uint32_t scramble_capacity;
+} Worker;
+
+static double now_seconds(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static int grow_moves(Move **p_moves, uint32_t *p_capacity, uint32_t needed) {
+    uint32_t capacity = *p_capacity;
+    Move *moves;
+
+    if (needed <= capacity) {
+        return 0;
+    }
+
+    while (capacity < needed) {
+        capacity = capacity == 0 ? INITIAL_SCRAMBLE_MOVES : 2 * capacity;
+    }
+    moves = (Move *)realloc(*p_moves, capacity * sizeof(Move));
+    if (moves == NULL) {
+        return -1;
+    }
+
+    *p_moves = moves;
+    *p_capacity = capacity;
+    return 0;
+}
+
+static void solve_job(Worker *worker, Job *job) {
+    Batch *batch = worker->batch;
+    Cube *cube = worker->cube;
+    double start = now_seconds();
+
+    job->move_count = 0;
+    if (parse_state(job->line, cube) != 0) {
+        // every token is at least one character and a wide turn or rotation
+        // expands to at most one move per layer
+        uint32_t max_moves = (strlen(job->line) + 1) * batch->sides;
+        uint32_t count;
+
+        copy_cube(cube, batch->solved);
+        if (grow_moves(&worker->scramble, &worker->scramble_capacity,
+                       max_moves) != 0 ||
+            parse_moves(job->line, batch->sides, worker->scramble,
+                        worker->scramble_capacity, &count) != 0) {
+            job->result = JR_BadLine;
+            goto done;
+        }
+        apply_moves(cube, worker->scramble, count);
+    }
+
+    if (solve_cube(worker->solver, cube, &worker->solution) != 0 ||
+        grow_moves(&job->moves, &job->move_capacity,
+                   worker->solution.move_count) != 0) {
+        job->result = JR_Unsolvable;
+        goto done;
+    }
+
+    memcpy(job->moves, worker->solution.moves,
+           worker->solution.move_count * sizeof(Move));
+    job->move_count = worker->solution.move_count;
+    job->result = JR_Solved;
+
+done:
+    job->seconds = now_seconds() - start;
+}
+
+static void *worker_main(void *arg) {
+    Worker *worker = (Worker *)arg;
+    Batch *batch = worker->batch;
+
+    pthread_mutex_lock(&batch->lock);
+    for (;;) {
+        Job *job;
+
+        while (batch->next_job == batch->read_count && !batch->input_done) {
+            pthread_cond_wait(&batch->work_ready, &batch->lock);
+        }
+        if (batch->next_job == batch->read_count) {
+            break;
+        }
+
+        job = batch->jobs + batch->next_job++ % BATCH_WINDOW;
+        pthread_mutex_unlock(&batch->lock);
+
+        solve_job(worker, job);
+
+        pthread_mutex_lock(&batch->lock);
+        job->done = 1;
+        pthread_cond_signal(&batch->job_done);
+    }
+    pthread_mutex_unlock(&batch->lock);
+
+    return NULL;
+}
+
+static int compare_doubles(void const *a, void const *b) {
+    double x = *(double const *)a;
+    double y = *(double const *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void fill_stats(BatchStats *stats, double *latencies,
+                       uint32_t const *move_counts) {
+    uint32_t count = stats->solved + stats->failed;
+
+    if (count > 0) {
+        qsort(latencies, count, sizeof(double), compare_doubles);
+        stats->p50_ms = 1e3 * latencies[(count - 1) * 50 / 100];
+        stats->p99_ms = 1e3 * latencies[(count - 1) * 99 / 100];
+        stats->max_ms = 1e3 * latencies[count - 1];
+    }
+
+    if (stats->solved == 0) {
+        return;
+    }
+
+    stats->min_moves = move_counts[0];
+    stats->max_moves = move_counts[0];
+    for (uint32_t i = 1; i < stats->solved; ++i) {
+        if (move_counts[i] < stats->min_moves) {
+            stats->min_moves = move_counts[i];
+        }
+        if (move_counts[i] > stats->max_moves) {
+            stats->max_moves = move_counts[i];
+        }
+    }
+
+    stats->bin_width =
+        (stats->max_moves - stats->min_moves) / BATCH_HISTOGRAM_BINS + 1;
+    for (uint32_t i = 0; i < stats->solved; ++i) {
+        uint32_t bin = (move_counts[i] - stats->min_moves) / stats->bin_width;
+
+        stats->histogram[bin] += 1;
+    }
+}
+
+// Reads lines into the window on a thread of its own, so that waiting on input
+// never holds up writing out the jobs already done
+static void *reader_main(void *arg) {
+    Batch *batch = (Batch *)arg;
+
+    pthread_mutex_lock(&batch->lock);
+    for (;;) {
+        Job *job;
+        int eof;
+
+        while (batch->read_count - batch->written == BATCH_WINDOW &&
+               !batch->input_done) {
+            pthread_cond_wait(&batch->window_room, &batch->lock);
+        }
+        if (batch->input_done) {
+            break;
+        }
+
+        job = batch->jobs + batch->read_count % BATCH_WINDOW;
+        pthread_mutex_unlock(&batch->lock);
+
+        eof = getline(&job->line, &job->line_capacity, batch->in) < 0;
+        job->done = 0;
+
+        pthread_mutex_lock(&batch->lock);
+        if (eof) {
+            batch->input_done = 1;
+            pthread_cond_broadcast(&batch->work_ready);
+            pthread_cond_signal(&batch->job_done);
+            break;
+        }
+        batch->read_count += 1;
+        pthread_cond_signal(&batch->work_ready);
+    }
+    pthread_mutex_unlock(&batch->lock);
+
+    return NULL;
+}
+
+int run_batch(FILE *in, FILE *out, BatchOptions options, BatchStats *p_stats) {
+    Batch *batch = NULL;
+    Worker *workers = NULL;
+    uint32_t thread_count = options.thread_count;
+    uint32_t started = 0;
+    int reading = 0;
+    uint32_t capacity = 0;
+    int unflushed = 0;
+    double *latencies = NULL;
+    uint32_t *move_counts = NULL;
+    BatchStats stats = {0};
+    double start = now_seconds();
+    int ret = -1;
+
+    if (thread_count == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+        thread_count = online > 0 ? (uint32_t)online : 1;
+    }
+    if (thread_count > MAX_THREADS) {
+        thread_count = MAX_THREADS;
+    }
+
+    batch = (Batch *)calloc(1, sizeof(Batch));
+    if (batch == NULL) {
+        return -1;
+    }
+    pthread_mutex_init(&batch->lock, NULL);
+    pthread_cond_init(&batch->work_ready, NULL);
+    pthread_cond_init(&batch->job_done, NULL);
+    pthread_cond_init(&batch->window_room, NULL);
+
+    batch->sides = options.sides;
+    batch->in = in;
+    batch->solved = new_cube(options.sides);
+    workers = (Worker *)calloc(thread_count, sizeof(Worker));
+    if (batch->solved == NULL || workers == NULL) {
+        goto cleanup;
+    }
+
+    for (uint32_t i = 0; i < thread_count; ++i) {
+        Worker *worker = workers + i;
+
+        worker->batch = batch;
+        worker->cube = new_cube(options.sides);
+        worker->solver = new_solver(options.sides);
+        if (worker->cube == NULL ||
+            pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+            free_cube(worker->cube);
+            free_solver(worker->solver);
+            break;
+        }
+        started += 1;
+    }
+    if (started == 0 ||
+        pthread_create(&batch->reader, NULL, reader_main, batch) != 0) {
+        goto cleanup;
+    }
+    reading = 1;
+
+    // Writes out the oldest job as soon as it is done, so output keeps the
+    // input order and streams. Whatever was written is flushed before waiting
+    // for the next one
+    pthread_mutex_lock(&batch->lock);
+    for (;;) {
+        Job *job = batch->jobs + batch->written % BATCH_WINDOW;
+
+        if (batch->written < batch->read_count && job->done) {
+            pthread_mutex_unlock(&batch->lock);
+
+            if (stats.solved + stats.failed == capacity) {
+                capacity = capacity == 0 ? BATCH_WINDOW : 2 * capacity;
+                latencies =
+                    (double *)realloc(latencies, capacity * sizeof(double));
+                move_counts = (uint32_t *)realloc(move_counts,
+                                                  capacity * sizeof(uint32_t));
+                DCHECK(latencies != NULL && move_counts != NULL,
+                       "Failed to grow batch statistics\n");
+            }
+            latencies[stats.solved + stats.failed] = job->seconds;
+
+            switch (job->result) {
+            case JR_Solved:
+                move_counts[stats.solved++] = job->move_count;
+                write_moves(out, job->moves, job->move_count);
+                break;
+            case JR_BadLine:
+                stats.failed += 1;
+                fprintf(out, "error: not a scramble or state\n");
+                break;
+            case JR_Unsolvable:
+                stats.failed += 1;
+                fprintf(out, "error: unsolvable\n");
+                break;
+            }
+            unflushed = 1;
+
+            pthread_mutex_lock(&batch->lock);
+            batch->written += 1;
+            pthread_cond_signal(&batch->window_room);
+            continue;
+        }
+
+        if (unflushed) {
+            pthread_mutex_unlock(&batch->lock);
+            fflush(out);
+            unflushed = 0;
+            pthread_mutex_lock(&batch->lock);
+            continue;
+        }
+
+        if (batch->input_done && batch->written == batch->read_count) {
+            break;
+        }
+
+        pthread_cond_wait(&batch->job_done, &batch->lock);
+    }
+    pthread_mutex_unlock(&batch->lock);
+
+    stats.threads = started;
+    stats.seconds = now_seconds() - start;
+    fill_stats(&stats, latencies, move_counts);
+    if (p_stats != NULL) {
+        *p_stats = stats;
+    }
+    ret = 0;
+
+cleanup:
+    pthread_mutex_lock(&batch->lock);
+    batch->input_done = 1;
+    pthread_cond_broadcast(&batch->work_ready);
+    pthread_cond_signal(&batch->window_room);
+    pthread_mutex_unlock(&batch->lock);
+    if (reading) {
+        pthread_join(batch->reader, NULL);
+    }
+    for (uint32_t i = 0; i < started; ++i) {
+        pthread_join(workers[i].thread, NULL);
+        free_cube(workers[i].cube);
+        free_solver(workers[i].solver);
+        free_solution(&workers[i].solution);
+        free(workers[i].scramble);
+    }
+    for (uint32_t i = 0; i < BATCH_WINDOW; ++i) {
+        free(batch->jobs[i].line);
+        free(batch->jobs[i].moves);
+    }
+    free_cube(batch->solved);
+    pthread_cond_destroy(&batch->window_room);
+    pthread_cond_destroy(&batch->job_done);
+    pthread_cond_destroy(&batch->work_ready);
+    pthread_mutex_destroy(&batch->lock);
+    free(move_counts);
+    free(latencies);
+    free(workers);
+    free(batch);
+
+    return ret;
+}
+
+void write_batch_stats(FILE *file, BatchStats const *stats) {
+    uint32_t largest = 1;
+
+    fprintf(file, "%u solved, %u failed in %.3f s on %u threads: %.1f solves "
+                  "per second\n",
+            stats->solved, stats->failed, stats->seconds, stats->threads,
+            stats->seconds > 0 ? stats->solved / stats->seconds : 0.0);
+    fprintf(file, "latency p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+            stats->p50_ms, stats->p99_ms, stats->max_ms);
+
+    if (stats->solved == 0) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < BATCH_HISTOGRAM_BINS; ++i) {
+        if (stats->histogram[i] > largest) {
+            largest = stats->histogram[i];
+        }
+    }
+
+    fprintf(file, "moves:\n");
+    for (uint32_t i = 0; i < BATCH_HISTOGRAM_BINS; ++i) {
+        uint32_t low = stats->min_moves + i * stats->bin_width;
+        uint32_t bar = stats->histogram[i] * HISTOGRAM_BAR / largest;
+
+        if (low > stats->max_moves) {
+            break;
+        }
+
+        fprintf(file, "%8u - %-8u %8u ", low, low + stats->bin_width - 1,
+                stats->histogram[i]);
+        for (uint32_t j = 0; j < bar; ++j) {
+            fputc('#', file);
+        }
+        fputc('\n', file);
+    }
+}
+
+int batch_main(int argc, char **argv) {
+    BatchOptions options = {0};
+    BatchStats stats;
+
+    if (argc < 1 || argc > 2 || atoi(argv[0]) < 1) {
+        fprintf(stderr, "usage: cube batch <sides> [threads] < scrambles\n");
+        return 1;
+    }
+
+    options.sides = atoi(argv[0]);
+    options.thread_count = argc > 1 ? atoi(argv[1]) : 0;
+
+    if (run_batch(stdin, stdout, options, &stats) != 0) {
+        fprintf(stderr, "Failed to start the batch workers\n");
+        return 1;
+    }
+    write_batch_stats(stderr, &stats);
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+#include "capture.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "common.h"
+
+struct capture_writer {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t frame_done;
+
+    // slots waiting to be written, oldest first
+    CaptureFrame frames[CAPTURE_MAX_SLOTS];
+    uint32_t queue[CAPTURE_MAX_SLOTS];
+    uint32_t first;
+    uint32_t count;
+    uint8_t busy[CAPTURE_MAX_SLOTS];
+
+    int stopping;
+    int failed;
+
+    // one row at a time, as RGB
+    uint8_t *row;
+    size_t row_capacity;
+};
+
+static int write_frame(CaptureWriter *writer, CaptureFrame const *frame) {
+    size_t row_size = (size_t)frame->width * 3;
+    int ret = 0;
+
+    if (row_size > writer->row_capacity) {
+        uint8_t *row = (uint8_t *)realloc(writer->row, row_size);
+        if (row == NULL) {
+            return -1;
+        }
+        writer->row = row;
+        writer->row_capacity = row_size;
+    }
+
+    if (fprintf(frame->file, "P6\n%u %u\n255\n", frame->width,
+                frame->height) < 0) {
+        ret = -1;
+    }
+
+    // PPM starts at the top
+    for (uint32_t y = frame->height; ret == 0 && y-- > 0;) {
+        uint8_t const *rgba = frame->pixels + (size_t)y * frame->width * 4;
+
+        for (uint32_t x = 0; x < frame->width; ++x) {
+            writer->row[3 * x + 0] = rgba[4 * x + 0];
+            writer->row[3 * x + 1] = rgba[4 * x + 1];
+            writer->row[3 * x + 2] = rgba[4 * x + 2];
+        }
+        if (fwrite(writer->row, 1, row_size, frame->file) != row_size) {
+            ret = -1;
+        }
+    }
+
+    if (frame->close_file && fclose(frame->file) != 0) {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+static void *writer_main(void *arg) {
+    CaptureWriter *writer = (CaptureWriter *)arg;
+
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        uint32_t slot;
+        int written;
+
+        while (writer->count == 0 && !writer->stopping) {
+            pthread_cond_wait(&writer->work_ready, &writer->lock);
+        }
+        if (writer->count == 0) {
+            break;
+        }
+
+        slot = writer->queue[writer->first];
+        writer->first = (writer->first + 1) % CAPTURE_MAX_SLOTS;
+        writer->count -= 1;
+        pthread_mutex_unlock(&writer->lock);
+
+        written = write_frame(writer, writer->frames + slot);
+
+        pthread_mutex_lock(&writer->lock);
+        writer->failed |= written != 0;
+        writer->busy[slot] = 0;
+        pthread_cond_broadcast(&writer->frame_done);
+    }
+    pthread_mutex_unlock(&writer->lock);
+
+    return NULL;
+}
+
+CaptureWriter *new_capture_writer(void) {
+    CaptureWriter *writer = (CaptureWriter *)calloc(1, sizeof(CaptureWriter));
+
+    if (writer == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->work_ready, NULL);
+    pthread_cond_init(&writer->frame_done, NULL);
+
+    if (pthread_create(&writer->thread, NULL, writer_main, writer) != 0) {
+        pthread_cond_destroy(&writer->frame_done);
+        pthread_cond_destroy(&writer->work_ready);
+        pthread_mutex_destroy(&writer->lock);
+        free(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+void free_capture_writer(CaptureWriter *writer) {
+    if (writer == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    writer->stopping = 1;
+    pthread_cond_signal(&writer->work_ready);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+
+    pthread_cond_destroy(&writer->frame_done);
+    pthread_cond_destroy(&writer->work_ready);
+    pthread_mutex_destroy(&writer->lock);
+    free(writer->row);
+    free(writer);
+}
+
+void submit_capture_frame(CaptureWriter *writer, uint32_t slot,
+                          CaptureFrame frame) {
+    DCHECK(slot < CAPTURE_MAX_SLOTS, "No capture slot %u\n", slot);
+
+    pthread_mutex_lock(&writer->lock);
+    DCHECK(!writer->busy[slot], "Capture slot %u is still busy\n", slot);
+
+    writer->frames[slot] = frame;
+    writer->busy[slot] = 1;
+    writer->queue[(writer->first + writer->count) % CAPTURE_MAX_SLOTS] = slot;
+    writer->count += 1;
+    pthread_cond_signal(&writer->work_ready);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+int is_capture_slot_busy(CaptureWriter *writer, uint32_t slot) {
+    int busy;
+
+    pthread_mutex_lock(&writer->lock);
+    busy = writer->busy[slot];
+    pthread_mutex_unlock(&writer->lock);
+
+    return busy;
+}
+
+int finish_capture_frames(CaptureWriter *writer) {
+    int failed;
+    int busy;
+
+    pthread_mutex_lock(&writer->lock);
+    do {
+        busy = 0;
+        for (uint32_t i = 0; i < CAPTURE_MAX_SLOTS; ++i) {
+            busy |= writer->busy[i];
+        }
+        if (busy) {
+            pthread_cond_wait(&writer->frame_done, &writer->lock);
+        }
+    } while (busy);
+
+    failed = writer->failed;
+    writer->failed = 0;
+    pthread_mutex_unlock(&writer->lock);
+
+    return failed ? -1 : 0;
+}
@@ -12,6 +12,9 @@ struct cube {
     int orientation;
     FaceColor facing_side;
     FaceColor *squares;
+
+    // rows changed since the last clear_dirty_rows
+    RowRange dirty[FC_Count];
 };
 
 static FaceColor opposite_faces[FC_Count] = {
@@ -30,6 +33,46 @@ static inline FaceColor get_at_rc(FaceColor *colors, uint32_t sides,
 static inline void set_at_rc(FaceColor *colors, uint32_t sides, uint32_t row,
                              uint32_t col, int dir, FaceColor fc);
 
+static void mark_rows(Cube *cube, FaceColor face, uint32_t first,
+                      uint32_t last) {
+    RowRange *dirty = cube->dirty + face;
+
+    if (dirty->first > dirty->last) {
+        *dirty = (RowRange){.first = first, .last = last};
+        return;
+    }
+
+    if (first < dirty->first) {
+        dirty->first = first;
+    }
+    if (last > dirty->last) {
+        dirty->last = last;
+    }
+}
+
+static void mark_all_rows(Cube *cube) {
+    for (FaceColor fc = 0; fc < FC_Count; ++fc) {
+        cube->dirty[fc] = (RowRange){.first = 0, .last = cube->sides - 1};
+    }
+}
+
+// the strip at `depth` read in direction `dir` is a row for 0 and 2, but a
+// column touching every row for 1 and 3
+static void mark_strip(Cube *cube, FaceColor face, uint32_t depth, int dir) {
+    uint32_t last = cube->sides - 1;
+
+    switch (dir) {
+    case 0:
+        mark_rows(cube, face, depth, depth);
+        break;
+    case 2:
+        mark_rows(cube, face, last - depth, last - depth);
+        break;
+    default:
+        mark_rows(cube, face, 0, last);
+    }
+}
+
 Cube *new_cube(uint32_t sides) {
     if (sides < 1) {
         return NULL;
@@ -58,6 +101,7 @@ Cube *new_cube(uint32_t sides) {
     };
 
     initialize_cube(res);
+    mark_all_rows(res);
     return res;
 }
 
@@ -71,6 +115,18 @@ void free_cube(Cube *cube) {
     free(cube);
 }
 
+void copy_cube(Cube *dst, Cube *src) {
+    DCHECK(dst->sides == src->sides,
+           "Cannot copy a cube with %d sides into one with %d sides\n",
+           src->sides, dst->sides);
+
+    memcpy(dst->squares, src->squares,
+           6 * (src->sides * src->sides) * sizeof(FaceColor));
+    dst->orientation = src->orientation;
+    dst->facing_side = src->facing_side;
+    mark_all_rows(dst);
+}
+
 void rotate_front(Cube *cube, uint32_t depth, int clockwise) {
     DCHECK(depth < cube->sides,
            "Invalid rotation depth. Expected 0 <= depth < %d, but got %d\n",
@@ -87,6 +143,8 @@ void rotate_front(Cube *cube, uint32_t depth, int clockwise) {
         int clockwise_colors = depth == 0 ? clockwise : !clockwise;
 
         FaceColor *face = cube->squares + (rotation_center * colors_per_side);
+
+        mark_rows(cube, rotation_center, 0, sides - 1);
         for (uint32_t d = 0; d < sides / 2; ++d) {
             for (uint32_t c = d; c < (sides - 1) - d; ++c) {
                 FaceColor ul = get_at_rc(face, sides, d, c, 0);
@@ -131,6 +189,11 @@ void rotate_front(Cube *cube, uint32_t depth, int clockwise) {
     FaceColor *sou = cube->squares + (colors_per_side * sou_col);
     FaceColor *wes = cube->squares + (colors_per_side * wes_col);
 
+    mark_strip(cube, nor_col, depth, nor_back_dir);
+    mark_strip(cube, eas_col, depth, eas_back_dir);
+    mark_strip(cube, sou_col, depth, sou_back_dir);
+    mark_strip(cube, wes_col, depth, wes_back_dir);
+
     for (uint32_t c = 0; c < sides; ++c) {
         FaceColor nor_fc = get_at_rc(nor, sides, depth, c, nor_back_dir);
         FaceColor eas_fc = get_at_rc(eas, sides, depth, c, eas_back_dir);
@@ -161,10 +224,41 @@ void set_facing_side(Cube *cube, FaceColor facing_side) {
     cube->facing_side = facing_side;
 }
 
+FaceColor get_facing_side(Cube *cube) { return cube->facing_side; }
+
 void set_orientation(Cube *cube, int orientation) {
     cube->orientation = orientation;
 }
 
+// where each face sits in the net, in face sized blocks, and the direction its
+// stickers are read in so that the net folds back into the cube
+static uint32_t const net_block_row[FC_Count] = {
+    [FC_White] = 0,  //
+    [FC_Green] = 1,  //
+    [FC_Red] = 1,    //
+    [FC_Blue] = 1,   //
+    [FC_Orange] = 1, //
+    [FC_Yellow] = 2, //
+};
+
+static uint32_t const net_block_col[FC_Count] = {
+    [FC_White] = 1,  //
+    [FC_Green] = 0,  //
+    [FC_Red] = 1,    //
+    [FC_Blue] = 2,   //
+    [FC_Orange] = 3, //
+    [FC_Yellow] = 1, //
+};
+
+static int const net_dir[FC_Count] = {
+    [FC_White] = 2,  //
+    [FC_Green] = 0,  //
+    [FC_Red] = 3,    //
+    [FC_Blue] = 2,   //
+    [FC_Orange] = 3, //
+    [FC_Yellow] = 2, //
+};
+
 void generic_write_cube(Cube *cube, void *buf, Spacing spacing,
                         WriterFunction write_func) {
     uint32_t sides = cube->sides;
@@ -176,34 +270,12 @@ void generic_write_cube(Cube *cube, void *buf, Spacing spacing,
     uint32_t trailing_v = spacing.trailing_v;
     uint32_t stride = (4 * sides + 3 * vgap + trailing_v);
 
-#define HOR ((sides + hgap) * stride)
-#define VER (sides + vgap)
-
-    uint32_t starts[FC_Count] = {
-        [FC_White] = (0 * HOR + 1 * VER) * item_size,
-        [FC_Green] = (1 * HOR + 0 * VER) * item_size,
-        [FC_Red] = (1 * HOR + 1 * VER) * item_size,
-        [FC_Blue] = (1 * HOR + 2 * VER) * item_size,
-        [FC_Orange] = (1 * HOR + 3 * VER) * item_size,
-        [FC_Yellow] = (2 * HOR + 1 * VER) * item_size,
-    };
-
-#undef VER
-#undef HOR
-
-    int print_dir[FC_Count] = {
-        [FC_White] = 2,  //
-        [FC_Green] = 0,  //
-        [FC_Red] = 3,    //
-        [FC_Blue] = 2,   //
-        [FC_Orange] = 3, //
-        [FC_Yellow] = 2, //
-    };
-
     for (FaceColor fc = 0; fc < FC_Count; ++fc) {
         FaceColor *face = cube->squares + (colors_per_side * fc);
-        char *buf_start = (char *)buf + starts[fc];
-        int dir = print_dir[fc];
+        uint32_t start = net_block_row[fc] * (sides + hgap) * stride +
+                         net_block_col[fc] * (sides + vgap);
+        char *buf_start = (char *)buf + start * item_size;
+        int dir = net_dir[fc];
 
         for (uint32_t r = 0; r < sides; ++r) {
             for (uint32_t c = 0; c < sides; ++c) {
@@ -506,3 +578,346 @@ void checkerboard(Cube *cube) {
     cube->orientation = orientation;
     cube->facing_side = facing_side;
 }
+
+static char const move_face_names[FC_Count] = {
+    [FC_White] = 'D',  //
+    [FC_Red] = 'F',    //
+    [FC_Blue] = 'L',   //
+    [FC_Orange] = 'B', //
+    [FC_Green] = 'R',  //
+    [FC_Yellow] = 'U', //
+};
+
+void apply_move(Cube *cube, Move move) {
+    FaceColor facing_side = cube->facing_side;
+
+    cube->facing_side = (FaceColor)move.face;
+    if (move.turns == 3) {
+        rotate_front(cube, move.depth, 0);
+    } else {
+        for (uint32_t t = 0; t < move.turns; ++t) {
+            rotate_front(cube, move.depth, 1);
+        }
+    }
+
+    cube->facing_side = facing_side;
+}
+
+void apply_moves(Cube *cube, Move const *moves, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+        apply_move(cube, moves[i]);
+    }
+}
+
+Move invert_move(Move move) {
+    move.turns = (4 - move.turns) % 4;
+    return move;
+}
+
+// the color letters print_cube uses, in FaceColor order
+static char const state_color_names[] = "WRBOGY";
+
+static int face_from_name(char name, FaceColor *p_face) {
+    for (FaceColor fc = 0; fc < FC_Count; ++fc) {
+        if (move_face_names[fc] == name) {
+            *p_face = fc;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+int parse_moves(char const *notation, uint32_t sides, Move *moves,
+                uint32_t max_moves, uint32_t *p_count) {
+    /*
+     * Accepts the usual big cube notation, separated by whitespace:
+     *   R, R', R2      outer layer turns
+     *   3R             the third layer from R on its own
+     *   Rw, 3Rw, r     the outer two (or three) layers together
+     *   M, E, S        middle slices of odd cubes, turning like L, D and F
+     *   x, y, z        whole cube rotations, turning like R, U and F
+     * Wide turns and rotations expand to one Move per layer.
+     */
+
+    char const *cur = notation;
+    uint32_t count = 0;
+
+    while (*cur != '\0') {
+        uint32_t prefix = 0;
+        uint32_t first_layer, last_layer;
+        uint8_t turns = 1;
+        FaceColor face;
+
+        if (*cur == ' ' || *cur == '\t' || *cur == '\n') {
+            ++cur;
+            continue;
+        }
+
+        while ('0' <= *cur && *cur <= '9') {
+            prefix = 10 * prefix + (uint32_t)(*cur - '0');
+            ++cur;
+        }
+
+        if (face_from_name(*cur, &face) == 0) {
+            if (cur[1] == 'w') {
+                first_layer = 0;
+                last_layer = prefix == 0 ? 1 : prefix - 1;
+                ++cur;
+            } else {
+                first_layer = prefix == 0 ? 0 : prefix - 1;
+                last_layer = first_layer;
+            }
+        } else if (face_from_name(*cur - 'a' + 'A', &face) == 0) {
+            first_layer = 0;
+            last_layer = prefix == 0 ? 1 : prefix - 1;
+        } else if (*cur == 'M' || *cur == 'E' || *cur == 'S') {
+            if (prefix != 0 || sides % 2 == 0) {
+                return -1;
+            }
+
+            face = *cur == 'M' ? FC_Blue : *cur == 'E' ? FC_White : FC_Red;
+            first_layer = sides / 2;
+            last_layer = first_layer;
+        } else if (*cur == 'x' || *cur == 'y' || *cur == 'z') {
+            if (prefix != 0) {
+                return -1;
+            }
+
+            face = *cur == 'x' ? FC_Green : *cur == 'y' ? FC_Yellow : FC_Red;
+            first_layer = 0;
+            last_layer = sides - 1;
+        } else {
+            return -1;
+        }
+        ++cur;
+
+        if (*cur == '2') {
+            turns = 2;
+            ++cur;
+        }
+        if (*cur == '\'') {
+            turns = turns == 2 ? 2 : 3;
+            ++cur;
+        }
+
+        if (last_layer >= sides) {
+            return -1;
+        }
+
+        for (uint32_t layer = first_layer; layer <= last_layer; ++layer) {
+            if (count >= max_moves) {
+                return -1;
+            }
+
+            moves[count++] = (Move){
+                .face = (uint8_t)face,
+                .turns = turns,
+                .depth = (uint16_t)layer,
+            };
+        }
+    }
+
+    *p_count = count;
+    return 0;
+}
+
+void write_moves(FILE *file, Move const *moves, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+        Move move = moves[i];
+
+        if (i > 0) {
+            fputc(' ', file);
+        }
+        if (move.depth > 0) {
+            fprintf(file, "%u", move.depth + 1);
+        }
+        fprintf(file, "%c%s", move_face_names[move.face],
+                move.turns == 2   ? "2"
+                : move.turns == 3 ? "'"
+                                  : "");
+    }
+    fputc('\n', file);
+}
+
+void print_moves(Move const *moves, uint32_t count) {
+    write_moves(stdout, moves, count);
+}
+
+int parse_state(char const *text, Cube *cube) {
+    uint32_t count = FC_Count * cube->sides * cube->sides;
+    uint32_t read = 0;
+
+    // check the whole text first so a bad line leaves the cube alone
+    for (char const *cur = text; *cur != '\0'; ++cur) {
+        if (*cur == ' ' || *cur == '\t' || *cur == '\n') {
+            continue;
+        }
+        if (strchr(state_color_names, *cur) == NULL || ++read > count) {
+            return -1;
+        }
+    }
+    if (read != count) {
+        return -1;
+    }
+
+    read = 0;
+    for (char const *cur = text; *cur != '\0'; ++cur) {
+        char const *name = strchr(state_color_names, *cur);
+
+        if (name != NULL) {
+            cube->squares[read++] = (FaceColor)(name - state_color_names);
+        }
+    }
+    mark_all_rows(cube);
+
+    return 0;
+}
+
+FaceColor const *get_squares(Cube *cube) { return cube->squares; }
+
+int is_solved(Cube *cube) {
+    uint32_t colors_per_side = cube->sides * cube->sides;
+
+    for (FaceColor fc = 0; fc < FC_Count; ++fc) {
+        FaceColor *face = cube->squares + (fc * colors_per_side);
+
+        for (uint32_t i = 1; i < colors_per_side; ++i) {
+            if (face[i] != face[0]) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+#define MAX_PERMUTED_STICKERS 32
+
+void permute_stickers(Cube *cube, uint32_t const *from, uint32_t const *to,
+                      uint32_t count) {
+    FaceColor moved[MAX_PERMUTED_STICKERS];
+
+    DCHECK(count <= MAX_PERMUTED_STICKERS,
+           "Can permute at most %d stickers at once, got %d\n",
+           MAX_PERMUTED_STICKERS, count);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        moved[i] = cube->squares[from[i]];
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t row = to[i] / cube->sides;
+
+        cube->squares[to[i]] = moved[i];
+        mark_rows(cube, row / cube->sides, row % cube->sides,
+                  row % cube->sides);
+    }
+}
+
+void get_dirty_rows(Cube *cube, RowRange rows[FC_Count]) {
+    memcpy(rows, cube->dirty, sizeof(cube->dirty));
+}
+
+void clear_dirty_rows(Cube *cube) {
+    for (FaceColor fc = 0; fc < FC_Count; ++fc) {
+        cube->dirty[fc] = (RowRange){.first = cube->sides, .last = 0};
+    }
+}
+
+void get_sticker_layers(uint32_t sides, FaceColor face, uint32_t row,
+                        uint32_t col, uint32_t layers[3]) {
+    uint32_t last = sides - 1;
+
+    // layers[0] is counted from white, [1] from red and [2] from blue
+    switch (face) {
+    case FC_White: {
+        layers[0] = 0;
+        layers[1] = row;
+        layers[2] = col;
+    } break;
+    case FC_Red: {
+        layers[0] = col;
+        layers[1] = 0;
+        layers[2] = row;
+    } break;
+    case FC_Blue: {
+        layers[0] = last - row;
+        layers[1] = last - col;
+        layers[2] = 0;
+    } break;
+    case FC_Orange: {
+        layers[0] = col;
+        layers[1] = last;
+        layers[2] = last - row;
+    } break;
+    case FC_Green: {
+        layers[0] = row;
+        layers[1] = last - col;
+        layers[2] = last;
+    } break;
+    case FC_Yellow: {
+        layers[0] = last;
+        layers[1] = last - row;
+        layers[2] = col;
+    } break;
+    default:
+        assert(!"Unreachable");
+    }
+}
+
+int get_sticker_at(uint32_t sides, FaceColor face, uint32_t const layers[3],
+                   uint32_t *p_row, uint32_t *p_col) {
+    uint32_t last = sides - 1;
+    uint32_t w = layers[0];
+    uint32_t r = layers[1];
+    uint32_t b = layers[2];
+
+    switch (face) {
+    case FC_White: {
+        if (w != 0) {
+            return -1;
+        }
+        *p_row = r;
+        *p_col = b;
+    } break;
+    case FC_Red: {
+        if (r != 0) {
+            return -1;
+        }
+        *p_row = b;
+        *p_col = w;
+    } break;
+    case FC_Blue: {
+        if (b != 0) {
+            return -1;
+        }
+        *p_row = last - w;
+        *p_col = last - r;
+    } break;
+    case FC_Orange: {
+        if (r != last) {
+            return -1;
+        }
+        *p_row = last - b;
+        *p_col = w;
+    } break;
+    case FC_Green: {
+        if (b != last) {
+            return -1;
+        }
+        *p_row = w;
+        *p_col = last - r;
+    } break;
+    case FC_Yellow: {
+        if (w != last) {
+            return -1;
+        }
+        *p_row = last - r;
+        *p_col = b;
+    } break;
+    default:
+        return -1;
+    }
+
+    return 0;
+}
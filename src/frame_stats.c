@@ -0,0 +1,79 @@
+#include "frame_stats.h"
+
+#include <string.h>
+
+static uint32_t get_bin(uint32_t time_us) {
+    uint32_t bin = time_us / FRAME_STATS_BIN_US;
+
+    return bin < FRAME_STATS_BINS ? bin : FRAME_STATS_BINS - 1;
+}
+
+static int is_missed(FrameStats const *stats, uint32_t time_us) {
+    return time_us > 1.5e6 * stats->target_seconds;
+}
+
+void init_frame_stats(FrameStats *stats, double target_seconds) {
+    memset(stats, 0, sizeof(*stats));
+    stats->target_seconds = target_seconds;
+}
+
+void record_frame(FrameStats *stats, double seconds) {
+    uint32_t time_us = seconds < 4e3 ? (uint32_t)(seconds * 1e6) : UINT32_MAX;
+    uint32_t *slot = stats->times_us + stats->next;
+
+    // the oldest frame makes room once the window is full
+    if (stats->count == FRAME_STATS_WINDOW) {
+        stats->bins[get_bin(*slot)] -= 1;
+        stats->missed -= is_missed(stats, *slot);
+    } else {
+        stats->count += 1;
+    }
+
+    *slot = time_us;
+    stats->bins[get_bin(time_us)] += 1;
+    stats->missed += is_missed(stats, time_us);
+    stats->next = (stats->next + 1) % FRAME_STATS_WINDOW;
+
+    stats->total_frames += 1;
+    stats->total_missed += is_missed(stats, time_us);
+}
+
+double frame_percentile(FrameStats const *stats, uint32_t percent) {
+    uint32_t rank, seen = 0;
+
+    if (stats->count == 0) {
+        return 0.0;
+    }
+
+    // as the batch stats pick from sorted latencies
+    rank = (stats->count - 1) * percent / 100;
+    for (uint32_t bin = 0; bin < FRAME_STATS_BINS; ++bin) {
+        seen += stats->bins[bin];
+        if (seen > rank) {
+            return (bin + 1) * FRAME_STATS_BIN_US / 1e6;
+        }
+    }
+
+    return FRAME_STATS_BINS * FRAME_STATS_BIN_US / 1e6;
+}
+
+void write_frame_stats(FILE *file, FrameStats const *stats) {
+    uint32_t max_us = 0;
+
+    for (uint32_t i = 0; i < stats->count; ++i) {
+        if (stats->times_us[i] > max_us) {
+            max_us = stats->times_us[i];
+        }
+    }
+
+    fprintf(file,
+            "last %u frames: p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f "
+            "ms, %u missed the %.2f ms target\n",
+            stats->count, 1e3 * frame_percentile(stats, 50),
+            1e3 * frame_percentile(stats, 95),
+            1e3 * frame_percentile(stats, 99), max_us / 1e3, stats->missed,
+            1e3 * stats->target_seconds);
+    fprintf(file, "all %llu frames: %llu missed\n",
+            (unsigned long long)stats->total_frames,
+            (unsigned long long)stats->total_missed);
+}
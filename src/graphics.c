@@ -1,8 +1,11 @@
 #include "graphics.h"
 
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 
 #include "common.h"
+#include "headless.h"
 
 #define _DEBUG
 
@@ -15,6 +18,8 @@
 
 #define VERTEX_SHADER_NAME "./shaders/cube.vert"
 #define FRAGMENT_SHADER_NAME "./shaders/cube.frag"
+#define STICKER_VERTEX_SHADER_NAME "./shaders/sticker.vert"
+#define STICKER_FRAGMENT_SHADER_NAME "./shaders/sticker.frag"
 
 #define RHO_PIXELS_PER_SEC 20.0
 #define THETA_PIXELS_PER_SEC (4.0 * PI / 5.0)
@@ -26,10 +31,38 @@
 #define DANGEROUS_CLAMP(min, n, max) (DANGEROUS_MIN(max, DANGEROUS_MAX(min, n)))
 
 #define FRAMES 60.0
-static double target_mspf = 1000.0 / FRAMES;
+#define FRAME_SECONDS (1.0 / FRAMES)
+
+// SDL_Delay sleeps whole milliseconds, and often longer than asked, so the
+// last PACE_SPIN_SECONDS before a frame's deadline are spun out on the
+// performance counter instead
+#define PACE_SPIN_SECONDS 0.002
+
+// With nothing moving the loop sleeps until an event comes in, waking up this
+// often regardless
+#define IDLE_TIMEOUT_MS 1000
+
+#define WINDOW_TITLE "Rubik's Cube"
+
+// Time the solver gets each frame, and how fast its solution is played back.
+// Long solutions speed up so that playback never takes much longer than
+// MAX_PLAYBACK_SECONDS
+#define SOLVE_SLICE_SECONDS 0.002
+#define TURN_SECONDS 0.2
+#define PLAYBACK_MOVES_PER_SEC 8.0
+#define MAX_PLAYBACK_SECONDS 10.0
 
 static int print_a_thing = 0;
 
+static Color const default_palette[PALETTE_SIZE] = {
+    [FC_White] = {.r = 0xFF, .g = 0xFF, .b = 0xFF},
+    [FC_Green] = {.r = 0x00, .g = 0xFF, .b = 0x00},
+    [FC_Red] = {.r = 0xFF, .g = 0x00, .b = 0x00},
+    [FC_Blue] = {.r = 0x00, .g = 0x00, .b = 0xFF},
+    [FC_Orange] = {.r = 0xFF, .g = 0xA5, .b = 0x00},
+    [FC_Yellow] = {.r = 0xFF, .g = 0xFF, .b = 0x00},
+};
+
 static Camera get_initial_camera(void) {
     return (Camera){
         .rho = 2.0 * CAMERA_SCREEN_DIST,
@@ -50,6 +83,15 @@ static State get_initial_state(void) {
         .mouse_held = 0,
         .mouse_clicked_cube = 0,
         .cube_intersection_found = 0,
+        .cube_turned = 0,
+        .needs_redraw = 1,
+
+        .render_path = RP_Faces,
+
+        .solve_status = SS_Idle,
+        .solve_percent = 0,
+        .solve_index = 0,
+        .solve_clock = 0.0,
 
         .screen_mouse_x = 0,
         .screen_mouse_y = 0,
@@ -85,7 +127,7 @@ static int sdl_init(SDL_Window **window) {
     SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
     SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
 
-    *window = SDL_CreateWindow("Rubik's Cube", SDL_WINDOWPOS_CENTERED,
+    *window = SDL_CreateWindow(WINDOW_TITLE, SDL_WINDOWPOS_CENTERED,
                                SDL_WINDOWPOS_CENTERED, INIT_WIDTH, INIT_HEIGHT,
                                SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN |
                                    SDL_WINDOW_RESIZABLE);
@@ -209,7 +251,8 @@ static int gl_link_program(GLuint *program, GLuint vertex_shader,
     return 0;
 }
 
-static int load_cube_shader_programs(GLuint *gl_program) {
+static int load_shader_program(char const *vert_name, char const *frag_name,
+                               GLuint *gl_program) {
     int ret = 0;
     GLuint vert_shader, frag_shader;
 
@@ -217,12 +260,12 @@ static int load_cube_shader_programs(GLuint *gl_program) {
     char *frag_contents = NULL;
     long vert_size, frag_size;
 
-    if (load_file(VERTEX_SHADER_NAME, &vert_size, &vert_contents) != 0) {
+    if (load_file(vert_name, &vert_size, &vert_contents) != 0) {
         fprintf(stderr, "Failed to load vertex shader contents\n");
         goto vert_load_fail;
     }
 
-    if (load_file(FRAGMENT_SHADER_NAME, &frag_size, &frag_contents) != 0) {
+    if (load_file(frag_name, &frag_size, &frag_contents) != 0) {
         fprintf(stderr, "Failed to load fragment shader contents\n");
         goto frag_load_fail;
     }
@@ -247,6 +290,8 @@ static int load_cube_shader_programs(GLuint *gl_program) {
     // after linking, it's okay to delete these
     glDeleteShader(vert_shader);
     glDeleteShader(frag_shader);
+    free(frag_contents);
+    free(vert_contents);
 
     return ret;
 
@@ -269,27 +314,56 @@ vert_load_fail:
     return ret;
 }
 
+// Changing the colors is one small write, nothing has to be uploaded again
+static void set_palette(GLuint palette_ubo, Color const *colors) {
+    PaletteUniforms uniforms;
+
+    for (uint32_t i = 0; i < PALETTE_SIZE; ++i) {
+        uniforms.colors[i][0] = colors[i].r / 255.0f;
+        uniforms.colors[i][1] = colors[i].g / 255.0f;
+        uniforms.colors[i][2] = colors[i].b / 255.0f;
+        uniforms.colors[i][3] = 1.0f;
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, palette_ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(uniforms),
+                    (void const *)&uniforms);
+}
+
+// Without a `window` the context is already current, and has no default
+// framebuffer to draw to
 static int gl_init(SDL_Window *window, SDL_GLContext **p_gl_context,
-                   GLuint *p_gl_program, GraphicsCube *cube) {
+                   GLuint *p_gl_program, GLuint *p_sticker_program,
+                   GLuint *p_view_ubo, GLuint *p_palette_ubo,
+                   GraphicsCube *cube, ScaledTarget *scaled) {
     int ret = 0;
     SDL_GLContext context = NULL;
     GLenum glew_error;
     GLuint gl_program;
+    GLuint sticker_program = 0;
 
-    context = SDL_GL_CreateContext(window);
-    if (context == NULL) {
-        fprintf(stderr, "Could not create OpenGL context\n");
-        goto context_fail;
+    if (window != NULL) {
+        context = SDL_GL_CreateContext(window);
+        if (context == NULL) {
+            fprintf(stderr, "Could not create OpenGL context\n");
+            goto context_fail;
+        }
     }
 
-    if ((glew_error = glewInit()) != GLEW_OK) {
+    // GLEW built for GLX finds no X display under EGL, but loads the OpenGL
+    // functions all the same
+    glew_error = glewInit();
+    if (glew_error != GLEW_OK &&
+        (window != NULL || glew_error != GLEW_ERROR_NO_GLX_DISPLAY)) {
         fprintf(stderr, "Failed to initialize GLEW: %s\n",
                 glewGetErrorString(glew_error));
         goto glew_init_fail;
     }
 
     // TODO: figure out if this should be +1 or -1
-    SDL_GL_SetSwapInterval(-1);
+    if (window != NULL) {
+        SDL_GL_SetSwapInterval(-1);
+    }
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glCullFace(GL_BACK);
@@ -301,42 +375,96 @@ static int gl_init(SDL_Window *window, SDL_GLContext **p_gl_context,
     gl_debug_init();
 #endif
 
-    if (load_cube_shader_programs(&gl_program)) {
+    if (load_shader_program(VERTEX_SHADER_NAME, FRAGMENT_SHADER_NAME,
+                            &gl_program)) {
         fprintf(stderr, "Failed to link cube shader program\n");
         goto shader_load_fail;
     }
 
+    if (load_shader_program(STICKER_VERTEX_SHADER_NAME,
+                            STICKER_FRAGMENT_SHADER_NAME, &sticker_program)) {
+        fprintf(stderr, "Failed to link sticker shader program\n");
+        goto sticker_load_fail;
+    }
+
     glUseProgram(gl_program);
 
+    // the view information block reads from one buffer that stays bound
+    glGenBuffers(1, p_view_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, *p_view_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(ViewUniforms), NULL,
+                 GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, VIEW_UNIFORM_BINDING, *p_view_ubo);
+
+    glGenBuffers(1, p_palette_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, *p_palette_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(PaletteUniforms), NULL,
+                 GL_STATIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, PALETTE_UNIFORM_BINDING,
+                     *p_palette_ubo);
+    set_palette(*p_palette_ubo, default_palette);
+
+    // the core profile only draws with a vertex array bound, even if it has no
+    // attributes in it
     glGenVertexArrays(1, &cube->vao);
-    glGenBuffers(2, cube->vbo);
-    glGenBuffers(1, &cube->ebo);
     glGenTextures(1, &cube->texture);
+    glGenBuffers(TEXTURE_PBO_COUNT, cube->pbo);
+    glGenBuffers(1, &cube->color_buffer);
+    glGenTextures(1, &cube->color_texture);
+    glGenTextures(1, &cube->summary_texture);
+
+    glGenFramebuffers(1, &scaled->framebuffer);
+    glGenTextures(1, &scaled->color);
+    glGenRenderbuffers(1, &scaled->depth);
+    glGenQueries(GPU_TIMER_COUNT, scaled->queries);
+    scaled->scale = 1.0f;
 
     *p_gl_context = context;
     *p_gl_program = gl_program;
+    *p_sticker_program = sticker_program;
 
     return ret;
 
     // I suppose there's nothing that can fail between these getting created and
     // returning from the function...
 
-    if (cube->texture != 0) {
-        glDeleteTextures(1, &cube->texture);
+    if (cube->summary_texture != 0) {
+        glDeleteTextures(1, &cube->summary_texture);
+    }
+
+    if (cube->color_texture != 0) {
+        glDeleteTextures(1, &cube->color_texture);
+    }
+
+    if (cube->color_buffer != 0) {
+        glDeleteBuffers(1, &cube->color_buffer);
     }
 
-    if (cube->ebo != 0) {
-        glDeleteBuffers(1, &cube->ebo);
+    if (cube->pbo[0] != 0) {
+        glDeleteBuffers(TEXTURE_PBO_COUNT, cube->pbo);
     }
 
-    if (cube->vbo[0] != 0) {
-        glDeleteBuffers(2, cube->vbo);
+    if (cube->texture != 0) {
+        glDeleteTextures(1, &cube->texture);
     }
 
     if (cube->vao != 0) {
         glDeleteVertexArrays(1, &cube->vao);
     }
 
+    if (*p_palette_ubo != 0) {
+        glDeleteBuffers(1, p_palette_ubo);
+    }
+
+    if (*p_view_ubo != 0) {
+        glDeleteBuffers(1, p_view_ubo);
+    }
+
+    if (sticker_program != 0) {
+        glDeleteProgram(sticker_program);
+    }
+
+sticker_load_fail:
     if (gl_program != 0) {
         glDeleteProgram(gl_program);
     }
@@ -346,30 +474,258 @@ shader_load_fail:
 
 glew_init_fail:
     ret += 1;
-    SDL_GL_DeleteContext(context);
+    if (context != NULL) {
+        SDL_GL_DeleteContext(context);
+    }
 
 context_fail:
     ret += 1;
     return ret;
 }
 
+// Hands each slot whose read has finished to the writer, oldest first so that
+// frames are written in order, and takes back the ones it is done with. With
+// `wait` every read is waited for
+static void collect_captures(Capture *capture, int wait) {
+    for (uint32_t i = 0; i < CAPTURE_SLOT_COUNT; ++i) {
+        uint32_t index = (capture->next_slot + i) % CAPTURE_SLOT_COUNT;
+        CaptureSlot *slot = capture->slots + index;
+
+        if (slot->state == CS_Writing &&
+            !is_capture_slot_busy(capture->writer, index)) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            slot->state = CS_Free;
+        }
+
+        if (slot->state == CS_Reading) {
+            GLenum status =
+                glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                 wait ? GL_TIMEOUT_IGNORED : 0);
+            if (status == GL_TIMEOUT_EXPIRED) {
+                break;
+            }
+            glDeleteSync(slot->fence);
+
+            // the read may never have happened, the frame is lost
+            if (status == GL_WAIT_FAILED) {
+                fprintf(stderr, "Couldn't wait for a captured frame\n");
+                if (slot->frame.close_file) {
+                    fclose(slot->frame.file);
+                } else {
+                    capture->captured -= 1;
+                }
+                capture->dropped += 1;
+                slot->state = CS_Free;
+                continue;
+            }
+
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+            slot->frame.pixels = (uint8_t const *)glMapBufferRange(
+                GL_PIXEL_PACK_BUFFER, 0, slot->size, GL_MAP_READ_BIT);
+            if (slot->frame.pixels == NULL) {
+                fprintf(stderr, "Couldn't map a captured frame\n");
+                if (slot->frame.close_file) {
+                    fclose(slot->frame.file);
+                }
+                slot->state = CS_Free;
+                continue;
+            }
+
+            submit_capture_frame(capture->writer, index, slot->frame);
+            slot->state = CS_Writing;
+        }
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+// Waits for every captured frame to be written, and leaves the slots free
+static void flush_captures(Capture *capture) {
+    if (capture->writer == NULL) {
+        return;
+    }
+
+    collect_captures(capture, 1);
+    if (finish_capture_frames(capture->writer) != 0) {
+        fprintf(stderr, "Couldn't write some captured frames\n");
+    }
+    collect_captures(capture, 0);
+}
+
+static int init_capture(Capture *capture) {
+    if (capture->writer != NULL) {
+        return 0;
+    }
+
+    capture->writer = new_capture_writer();
+    if (capture->writer == NULL) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < CAPTURE_SLOT_COUNT; ++i) {
+        glGenBuffers(1, &capture->slots[i].pbo);
+    }
+
+    return 0;
+}
+
+// Queues a read of the frame just drawn to `framebuffer` into the next slot.
+// It fails if that slot is still busy
+static int capture_frame(Capture *capture, GLuint framebuffer, uint32_t width,
+                         uint32_t height, FILE *file, int close_file) {
+    CaptureSlot *slot = capture->slots + capture->next_slot;
+    size_t size = (size_t)width * height * 4;
+
+    if (slot->state != CS_Free) {
+        return -1;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+    if (slot->size != size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        slot->size = size;
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot->frame = (CaptureFrame){
+        .width = width,
+        .height = height,
+        .file = file,
+        .close_file = close_file,
+    };
+    slot->state = CS_Reading;
+    capture->next_slot = (capture->next_slot + 1) % CAPTURE_SLOT_COUNT;
+
+    return 0;
+}
+
+static void start_recording(Capture *capture) {
+    char name[64];
+
+    if (init_capture(capture) != 0) {
+        fprintf(stderr, "Couldn't start the capture writer\n");
+        return;
+    }
+
+    snprintf(name, sizeof(name), RECORDING_NAME_FORMAT, (long)time(NULL));
+    capture->recording = fopen(name, "wb");
+    if (capture->recording == NULL) {
+        fprintf(stderr, "Couldn't open %s to record to\n", name);
+        return;
+    }
+
+    capture->captured = 0;
+    capture->dropped = 0;
+    printf("Recording to %s\n", name);
+}
+
+static void stop_recording(Capture *capture) {
+    if (capture->recording == NULL) {
+        return;
+    }
+
+    flush_captures(capture);
+    fclose(capture->recording);
+    capture->recording = NULL;
+
+    printf("Recorded %u frames, dropped %u\n", capture->captured,
+           capture->dropped);
+}
+
+static void free_scaled_target(ScaledTarget *scaled) {
+    if (scaled->queries[0] != 0) {
+        glDeleteQueries(GPU_TIMER_COUNT, scaled->queries);
+    }
+
+    if (scaled->depth != 0) {
+        glDeleteRenderbuffers(1, &scaled->depth);
+    }
+
+    if (scaled->color != 0) {
+        glDeleteTextures(1, &scaled->color);
+    }
+
+    if (scaled->framebuffer != 0) {
+        glDeleteFramebuffers(1, &scaled->framebuffer);
+    }
+}
+
 static void app_cleanup(Application *app) {
-    if (app->cube.texture != 0) {
-        glDeleteTextures(1, &app->cube.texture);
+    if (app->scene.cubes != NULL) {
+        for (uint32_t k = 1; k < app->scene.cube_count; ++k) {
+            free_cube(app->scene.cubes[k]);
+        }
+        free(app->scene.cubes);
+    }
+
+    if (app->scene.transform_texture != 0) {
+        glDeleteTextures(1, &app->scene.transform_texture);
+    }
+
+    if (app->scene.transform_buffer != 0) {
+        glDeleteBuffers(1, &app->scene.transform_buffer);
+    }
+
+    free_solver(app->solver);
+    free_solution(&app->solution);
+    free(app->cube.regions);
+    free(app->cube.summary_counts);
+    free(app->cube.summary_seen);
+    free(app->cube.summary_texels);
+    free(app->cube.color_staging);
+
+    flush_captures(&app->capture);
+    free_capture_writer(app->capture.writer);
+    for (uint32_t i = 0; i < CAPTURE_SLOT_COUNT; ++i) {
+        if (app->capture.slots[i].pbo != 0) {
+            glDeleteBuffers(1, &app->capture.slots[i].pbo);
+        }
+    }
+
+    free_scaled_target(&app->scaled);
+    free_scaled_target(&app->offscreen);
+
+    if (app->cube.summary_texture != 0) {
+        glDeleteTextures(1, &app->cube.summary_texture);
+    }
+
+    if (app->cube.color_texture != 0) {
+        glDeleteTextures(1, &app->cube.color_texture);
+    }
+
+    if (app->cube.color_buffer != 0) {
+        glDeleteBuffers(1, &app->cube.color_buffer);
     }
 
-    if (app->cube.ebo != 0) {
-        glDeleteBuffers(1, &app->cube.ebo);
+    if (app->cube.pbo[0] != 0) {
+        glDeleteBuffers(TEXTURE_PBO_COUNT, app->cube.pbo);
     }
 
-    if (app->cube.vbo[0] != 0) {
-        glDeleteBuffers(2, app->cube.vbo);
+    if (app->cube.texture != 0) {
+        glDeleteTextures(1, &app->cube.texture);
     }
 
     if (app->cube.vao != 0) {
         glDeleteVertexArrays(1, &app->cube.vao);
     }
 
+    if (app->palette_ubo != 0) {
+        glDeleteBuffers(1, &app->palette_ubo);
+    }
+
+    if (app->view_ubo != 0) {
+        glDeleteBuffers(1, &app->view_ubo);
+    }
+
+    if (app->sticker_program != 0) {
+        glDeleteProgram(app->sticker_program);
+    }
+
     if (app->gl_program != 0) {
         glDeleteProgram(app->gl_program);
     }
@@ -389,11 +745,42 @@ static void app_cleanup(Application *app) {
     SDL_Quit();
 }
 
+// Nothing is moving and the last frame is still on screen, so nothing will
+// change until an event comes in
+static int is_idle(Application const *app) {
+    State const *state = &app->state;
+
+    return app->scene.cube_count == 1 && !state->needs_redraw &&
+           !state->should_rotate && !state->recording &&
+           state->turns.count == 0 && state->solve_status == SS_Idle;
+}
+
+// Returns the counter once it has reached `deadline`
+static Uint64 wait_until(Uint64 deadline) {
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 spin = (Uint64)(PACE_SPIN_SECONDS * frequency);
+    Uint64 counter = SDL_GetPerformanceCounter();
+
+    if (counter + spin < deadline) {
+        SDL_Delay((Uint32)((deadline - spin - counter) * 1000 / frequency));
+    }
+
+    while ((counter = SDL_GetPerformanceCounter()) < deadline) {
+    }
+
+    return counter;
+}
+
 static StateUpdate get_inputs(Application const *app) {
     SDL_Event event;
-    Uint32 last_ticks, ticks;
     StateUpdate s_update = {0};
-    double cur_delta_ms;
+    Uint64 frequency, deadline, counter;
+    int idle = is_idle(app);
+
+    // leaves the event in the queue for the loop below
+    if (idle) {
+        SDL_WaitEventTimeout(NULL, IDLE_TIMEOUT_MS);
+    }
 
     print_a_thing = 0;
     while (SDL_PollEvent(&event) > 0) {
@@ -409,6 +796,9 @@ static StateUpdate get_inputs(Application const *app) {
                 s_update.window_height = w_event.data2;
                 s_update.window_resized = 1;
             } break;
+            case SDL_WINDOWEVENT_EXPOSED: {
+                s_update.window_exposed = 1;
+            } break;
             }
         } break;
         case SDL_MOUSEBUTTONUP:
@@ -523,85 +913,55 @@ static StateUpdate get_inputs(Application const *app) {
             if (keys[SDL_SCANCODE_C] == 1) {
                 s_update.checkerboard = 1;
             }
-        } break;
-        }
-    }
-
-    last_ticks = app->last_ticks;
-    ticks = SDL_GetTicks();
-
-    cur_delta_ms = (double)(ticks - last_ticks);
-
-    if (cur_delta_ms < target_mspf) {
-        double diff = target_mspf - cur_delta_ms;
-
-        SDL_Delay((Uint32)diff);
-        cur_delta_ms += diff;
-    }
-
-    s_update.delta_time = cur_delta_ms / 1000.0;
-    s_update.ticks = ticks;
-
-    return s_update;
-}
 
-// assumes the point is in the plane of the triangle
-static int inside_triangle(V3 point, V3 ab, V3 ac) {
-    V3 bc_perp, cb_perp;
-    V3 ab_perp, ac_perp;
-
-    float x;
-    float y;
+            // switch between drawing textured faces and single stickers
+            if (keys[SDL_SCANCODE_M] == 1) {
+                s_update.toggle_render_path = 1;
+            }
 
-    decompose(ab, as_unit(ac), &bc_perp);
-    decompose(ac, as_unit(ab), &cb_perp);
+            // print how long recent frames took
+            if (keys[SDL_SCANCODE_F] == 1) {
+                s_update.dump_frame_stats = 1;
+            }
 
-    ab_perp = scale3(bc_perp, 1.0f / dot(bc_perp, ab));
-    ac_perp = scale3(cb_perp, 1.0f / dot(cb_perp, ac));
+            // trade resolution for frame time when the GPU can't keep up
+            if (keys[SDL_SCANCODE_D] == 1) {
+                s_update.toggle_dynamic_resolution = 1;
+            }
 
-    x = dot(point, ab_perp);
-    y = dot(point, ac_perp);
+            // start / stop recording every frame, or save just the next one
+            if (keys[SDL_SCANCODE_V] == 1) {
+                s_update.toggle_recording = 1;
+            }
+            if (keys[SDL_SCANCODE_G] == 1) {
+                s_update.take_screenshot = 1;
+            }
 
-    if ((0.0f <= x && x <= 1.0f) && (0.0f <= y && y <= 1.0f) &&
-        (x + y <= 1.0f)) {
-        return 1;
+            // solve the cube from its current state, or stop solving
+            if (keys[SDL_SCANCODE_SPACE] == 1) {
+                s_update.toggle_solve = 1;
+            }
+        } break;
+        }
     }
 
-    return 0;
-}
-
-static int check_intersection(V3 camera, V3 mouse_direction, V3 a, V3 b, V3 c,
-                              float *res_t) {
-    int intersects = 0;
-
-    V3 minus_a = scale3(a, -1.0f);
-    V3 ab = add3(b, minus_a);
-    V3 ac = add3(c, minus_a);
+    frequency = SDL_GetPerformanceFrequency();
+    deadline = app->last_counter + (Uint64)(FRAME_SECONDS * frequency);
 
-    V3 perp = cross(ab, ac);
-
-    float t = (dot(a, perp) - dot(camera, perp)) / dot(mouse_direction, perp);
-
-    V3 point = add3(camera, scale3(mouse_direction, t));
-
-    if (inside_triangle(add3(point, minus_a), ab, ac)) {
-        *res_t = t;
-        intersects = 1;
-
-        if (print_a_thing) {
-            printf("found intersection\n");
-            printf("  cam = {.x = %f, .y = %f, .z = %f},\n   md = {.x = %f, .y "
-                   "= %f, .z = %f},\npoint = {.x = %f, .y = %f, .z = %f},\n    "
-                   "a = {.x = %f, .y = "
-                   "%f, .z = %f},\n    b = {.x = %f, .y = %f, "
-                   ".z = %f},\n    c = {.x = %f, .y = %f, .z = %f}\n\n",
-                   camera.x, camera.y, camera.z, mouse_direction.x,
-                   mouse_direction.y, mouse_direction.z, point.x, point.y,
-                   point.z, a.x, a.y, a.z, b.x, b.y, b.z, c.x, c.y, c.z);
-        }
+    // time spent waiting isn't time anything was moving for, so the first
+    // frame after it counts as one frame
+    if (idle) {
+        counter = SDL_GetPerformanceCounter();
+        s_update.delta_time = FRAME_SECONDS;
+    } else {
+        counter = wait_until(deadline);
+        s_update.delta_time = (double)(counter - app->last_counter) / frequency;
     }
 
-    return intersects;
+    s_update.after_wait = idle;
+    s_update.counter = counter;
+
+    return s_update;
 }
 
 static V2 to_screen_coords(V3 target, V3 x_dir, V3 y_dir) {
@@ -619,7 +979,12 @@ static V3 const UNIT_X_AXIS = {.x = 1.0f, .y = 0.0f, .z = 0.0f};
 static V3 const UNIT_Y_AXIS = {.x = 0.0f, .y = 1.0f, .z = 0.0f};
 static V3 const UNIT_Z_AXIS = {.x = 0.0f, .y = 0.0f, .z = 1.0f};
 
-static BasisInformation get_basis_information(V3 camera_pos) {
+// The shaders used to project each corner onto a screen CAMERA_SCREEN_DIST in
+// front of the camera, the window's diagonal being 2 across. That is a
+// perspective projection with that focal length, so the same picture comes
+// from one matrix. Everything drawn is within `radius` of the origin
+static BasisInformation get_basis_information(V3 camera_pos, V2 dims,
+                                              float radius) {
     V3 minus_center = polar_to_rectangular(camera_pos);
     V3 cube_center = scale3(minus_center, -1.0);
     V3 unit_center = as_unit(cube_center);
@@ -637,6 +1002,16 @@ static BasisInformation get_basis_information(V3 camera_pos) {
     V3 y_loc = add3(UNIT_Y_AXIS, cube_center);
     V3 z_loc = add3(UNIT_Z_AXIS, cube_center);
 
+    float width = DANGEROUS_MAX(1.0f, dims.x);
+    float height = DANGEROUS_MAX(1.0f, dims.y);
+    float diagonal = sqrtf(width * width + height * height);
+
+    M4 view = look_at(minus_center, V3_of(0.0f, 0.0f, 0.0f), y_dir);
+    M4 projection = perspective(
+        CAMERA_SCREEN_DIST * diagonal / height, width / height,
+        DANGEROUS_MAX(camera_pos.rho - radius, 0.1f), camera_pos.rho + radius);
+    M4 view_projection = mul4(projection, view);
+
     return (BasisInformation){
         .x_dir = x_dir,
         .y_dir = y_dir,
@@ -644,6 +1019,10 @@ static BasisInformation get_basis_information(V3 camera_pos) {
         .screen_x_dir = to_screen_coords(x_loc, x_dir, y_dir),
         .screen_y_dir = to_screen_coords(y_loc, x_dir, y_dir),
         .screen_z_dir = to_screen_coords(z_loc, x_dir, y_dir),
+        .eye = minus_center,
+        .screen_cube_ratio = CAMERA_SCREEN_DIST / camera_pos.rho,
+        .view_projection = view_projection,
+        .inverse_view_projection = invert4(view_projection),
     };
 }
 
@@ -660,6 +1039,68 @@ static inline V2 pixel_to_screen(V2 pixel, V2 dims) {
     };
 }
 
+// Turns go through the queue so that they can be animated. A turn of the same
+// layer as the last one waiting is folded into it, and a full queue gives up
+// on animating its oldest turn
+static void queue_turn(TurnQueue *queue, Cube *cube, Move move) {
+    if (queue->count > 0) {
+        uint32_t last_index = queue->count - 1;
+        Move *last = queue->moves +
+                     (queue->first + last_index) % TURN_QUEUE_SIZE;
+        int animating = last_index == 0 && queue->progress > 0.0;
+
+        if (!animating && last->face == move.face &&
+            last->depth == move.depth) {
+            last->turns = (last->turns + move.turns) % 4;
+            if (last->turns == 0) {
+                queue->count -= 1;
+            }
+            return;
+        }
+    }
+
+    if (queue->count == TURN_QUEUE_SIZE) {
+        apply_move(cube, queue->moves[queue->first]);
+        queue->first = (queue->first + 1) % TURN_QUEUE_SIZE;
+        queue->count -= 1;
+        queue->progress = 0.0;
+    }
+
+    queue->moves[(queue->first + queue->count) % TURN_QUEUE_SIZE] = move;
+    queue->count += 1;
+}
+
+// Applies everything still waiting, for when the cube has to be up to date
+static void flush_turns(TurnQueue *queue, Cube *cube) {
+    for (uint32_t i = 0; i < queue->count; ++i) {
+        apply_move(cube, queue->moves[(queue->first + i) % TURN_QUEUE_SIZE]);
+    }
+
+    queue->count = 0;
+    queue->progress = 0.0;
+}
+
+// A turn takes TURN_SECONDS on its own, but the queue runs as many times
+// faster as it has turns waiting, so a backlog drains in about TURN_SECONDS
+// however long it gets
+static void advance_turns(TurnQueue *queue, Cube *cube, double delta_time) {
+    if (queue->count == 0) {
+        return;
+    }
+
+    queue->progress += delta_time * queue->count / TURN_SECONDS;
+    while (queue->count > 0 && queue->progress >= 1.0) {
+        apply_move(cube, queue->moves[queue->first]);
+        queue->first = (queue->first + 1) % TURN_QUEUE_SIZE;
+        queue->count -= 1;
+        queue->progress -= 1.0;
+    }
+
+    if (queue->count == 0) {
+        queue->progress = 0.0;
+    }
+}
+
 static void update_from_user_input(State *state, Cube *cube,
                                    StateUpdate s_update) {
     double delta_time = s_update.delta_time;
@@ -703,16 +1144,33 @@ static void update_from_user_input(State *state, Cube *cube,
         state->should_rotate = 1 - state->should_rotate;
     }
 
+    if (s_update.toggle_render_path) {
+        state->render_path = (state->render_path + 1) % RP_Count;
+    }
+
+    if (s_update.toggle_dynamic_resolution) {
+        state->dynamic_resolution = !state->dynamic_resolution;
+    }
+
     if (s_update.set_depth) {
         state->rotate_depth = s_update.rotate_depth;
     }
 
     if (s_update.rotate_front) {
-        rotate_front(cube, state->rotate_depth, 1);
+        Move move = {
+            .face = (uint8_t)get_facing_side(cube),
+            .turns = 1,
+            .depth = (uint16_t)state->rotate_depth,
+        };
+
+        queue_turn(&state->turns, cube, move);
+        state->cube_turned = 1;
     }
 
     if (s_update.checkerboard) {
+        flush_turns(&state->turns, cube);
         checkerboard(cube);
+        state->cube_turned = 1;
     }
 
     if (s_update.set_face) {
@@ -767,43 +1225,59 @@ static inline void force_point_to_cube_edge(V3 *point) {
     }
 }
 
-static int find_intersection(V3 camera_pos, V3 mouse_3,
-                             BasisInformation basis_info, GraphicsCube *cube,
+// Slab test against the [-1, 1] box: the ray is between each pair of face
+// planes for a range of t, and it is inside the cube where all three ranges
+// overlap. It enters through the face whose range starts last, so the hit
+// point is exactly on that face and the sticker follows from the point alone
+static int find_intersection(V3 origin, V3 direction,
                              HoverInformation *p_hover_info) {
-    int found = 0;
-    float closest_t = INFINITY;
-    HoverInformation hover_info = {0};
-
-    V3 minus_center = polar_to_rectangular(camera_pos);
-    V3 mouse_in_world =
-        compose(mouse_3, basis_info.x_dir, basis_info.y_dir, basis_info.z_dir);
-
-    for (uint32_t ind = 0; ind < cube->index_count; ind += 3) {
-        float res_t;
-        int ind0 = cube->indices[ind + 0];
-        int ind1 = cube->indices[ind + 1];
-        int ind2 = cube->indices[ind + 2];
-
-        int is_intersecting_triangle = check_intersection(
-            minus_center, mouse_in_world, cube->info[ind0].position,
-            cube->info[ind1].position, cube->info[ind2].position, &res_t);
-
-        if (is_intersecting_triangle) {
-            if (!found || res_t < closest_t) {
-                found = 1;
-                closest_t = res_t;
-                hover_info.hover_face = (FaceColor)cube->info[ind0].face_num;
-                hover_info.cube_intersection =
-                    add3(minus_center, scale3(mouse_in_world, closest_t));
+    float epsilon = 1e-8f;
+    float t_near = -INFINITY;
+    float t_far = INFINITY;
+    int near_axis = -1;
+    V3 point;
+
+    for (int axis = 0; axis < 3; ++axis) {
+        float o = origin.xyz[axis];
+        float d = direction.xyz[axis];
+        float t0, t1;
+
+        // parallel to this pair of faces, so it is always or never between
+        if (fabsf(d) < epsilon) {
+            if (o < -1.0f || o > 1.0f) {
+                return 0;
             }
+            continue;
+        }
+
+        t0 = (-1.0f - o) / d;
+        t1 = (+1.0f - o) / d;
+        if (t0 > t1) {
+            float tmp = t0;
+            t0 = t1;
+            t1 = tmp;
+        }
+
+        if (t0 > t_near) {
+            t_near = t0;
+            near_axis = axis;
         }
+        t_far = DANGEROUS_MIN(t_far, t1);
     }
 
-    if (found) {
-        *p_hover_info = hover_info;
+    if (near_axis < 0 || t_near > t_far || t_far < 0.0f) {
+        return 0;
     }
 
-    return found;
+    point = add3(origin, scale3(direction, t_near));
+    point.xyz[near_axis] = direction.xyz[near_axis] < 0.0f ? +1.0f : -1.0f;
+
+    *p_hover_info = (HoverInformation){
+        .hover_face = get_cube_face(point),
+        .cube_intersection = point,
+    };
+
+    return 1;
 }
 
 static int matching_direction(BasisInformation basis_info, V3 intersection,
@@ -909,28 +1383,36 @@ static int get_rotation_depth(FaceColor rotation_face, V3 intersection,
 }
 
 static void update_intersection_info(State *state, GraphicsCube *cube,
-                                     uint32_t toggled_click) {
+                                     float radius, uint32_t toggled_click) {
     V3 camera_pos = {
         .rho = state->camera.rho,
         .theta = state->camera.theta,
         .phi = state->camera.phi,
     };
+    V2 dims = {.x = state->window_width, .y = state->window_height};
 
-    V3 mouse_3 = {
-        .x = state->mouse.x,
-        .y = state->mouse.y,
-        .z = CAMERA_SCREEN_DIST,
-    };
-
-    BasisInformation basis_info = get_basis_information(camera_pos);
+    BasisInformation basis_info =
+        get_basis_information(camera_pos, dims, radius);
     int found = 0;
 
     state->basis_info = basis_info;
 
     if (toggled_click || !state->mouse_held) {
         HoverInformation hover_info;
-        found = find_intersection(camera_pos, mouse_3, basis_info, cube,
-                                  &hover_info);
+
+        // the mouse is in units of half the window's diagonal, and undoing the
+        // projection from the near plane gives a point along its ray
+        float diagonal = sqrtf(dot2(dims, dims));
+        V3 near_point = {
+            .x = state->mouse.x * diagonal / DANGEROUS_MAX(1.0f, dims.x),
+            .y = state->mouse.y * diagonal / DANGEROUS_MAX(1.0f, dims.y),
+            .z = -1.0f,
+        };
+        V3 direction = add3(
+            transform_point(basis_info.inverse_view_projection, near_point),
+            scale3(basis_info.eye, -1.0f));
+
+        found = find_intersection(basis_info.eye, direction, &hover_info);
 
         if (found) {
             state->cube_intersection_found = 1;
@@ -979,8 +1461,15 @@ static void update_intersection_info(State *state, GraphicsCube *cube,
 
                 int rotation_depth = get_rotation_depth(
                     rotation_face, intersection, get_side_count(cube->cube));
+                Move move = {
+                    .face = (uint8_t)rotation_face,
+                    .turns = 3,
+                    .depth = (uint16_t)rotation_depth,
+                };
+
                 set_facing_side(cube->cube, rotation_face);
-                rotate_front(cube->cube, rotation_depth, 0);
+                queue_turn(&state->turns, cube->cube, move);
+                state->cube_turned = 1;
             }
         }
 
@@ -992,576 +1481,1137 @@ static void update_intersection_info(State *state, GraphicsCube *cube,
     }
 }
 
-static void update(Application *app, StateUpdate s_update) {
-    State *state = &app->state;
-
-    update_from_user_input(state, app->cube.cube, s_update);
-    update_intersection_info(state, &app->cube, s_update.toggle_mouse_click);
+static void set_solve_title(Application *app, char const *status) {
+    char title[64];
 
-    if (print_a_thing) {
-        printf(
-            "\nScreen dirs:\n"
-            "x_axis = {.x = %f, .y = %f}\n"
-            "y_axis = {.x = %f, .y = %f}\n"
-            "z_axis = {.x = %f, .y = %f}\n",
-            state->basis_info.screen_x_dir.x, state->basis_info.screen_x_dir.y,
-            state->basis_info.screen_y_dir.x, state->basis_info.screen_y_dir.y,
-            state->basis_info.screen_z_dir.x, state->basis_info.screen_z_dir.y);
+    if (status == NULL) {
+        SDL_SetWindowTitle(app->window, WINDOW_TITLE);
+        return;
     }
 
-    app->last_ticks = s_update.ticks;
+    snprintf(title, sizeof(title), "%s - %s", WINDOW_TITLE, status);
+    SDL_SetWindowTitle(app->window, title);
 }
 
-typedef struct {
-    unsigned char r, g, b;
-} Color;
-
-static void write_color_for_face(void *v_buf, FaceColor fc) {
-    Color *buf = (Color *)v_buf;
-
-    static Color fc_color[FC_Count] = {
-        [FC_White] = {.r = 0xFF, .g = 0xFF, .b = 0xFF},
-        [FC_Green] = {.r = 0x00, .g = 0xFF, .b = 0x00},
-        [FC_Red] = {.r = 0xFF, .g = 0x00, .b = 0x00},
-        [FC_Blue] = {.r = 0x00, .g = 0x00, .b = 0xFF},
-        [FC_Orange] = {.r = 0xFF, .g = 0xA5, .b = 0x00},
-        [FC_Yellow] = {.r = 0xFF, .g = 0xFF, .b = 0x00},
-    };
-
-    *buf = fc_color[fc];
+static void stop_solving(Application *app) {
+    app->state.solve_status = SS_Idle;
+    set_solve_title(app, NULL);
 }
 
-static void create_texture_from_cube(Application const *app, Color **p_texture,
-                                     uint32_t *p_width, uint32_t *p_height) {
-    uint32_t side_count = get_side_count(app->cube.cube);
+static void start_solving(Application *app) {
+    State *state = &app->state;
+    Cube *cube = app->cube.cube;
 
-    uint32_t item_size = sizeof(Color);
-    uint32_t stride = 4 * side_count;
-    uint32_t height = 4 * side_count;
-    uint32_t rect_size = stride * height;
+    if (app->solver == NULL) {
+        app->solver = new_solver(get_side_count(cube));
+    }
 
-    Spacing spacing = {
-        .item_size = item_size,
-        .hgap = 0,
-        .vgap = 0,
-        .trailing_v = 0,
-    };
+    // the solver starts from the cube as it will be once the turns are shown
+    flush_turns(&state->turns, cube);
 
-    Color clear_color = {.r = 0xFF, .g = 0x00, .b = 0xFF};
-    Color *texture = ARENA_PUSH_N(Color, app->arena, rect_size * item_size);
+    solve_begin(app->solver, cube, &app->solution);
+    state->solve_status = SS_Solving;
+    state->solve_percent = 0;
+    set_solve_title(app, "solving 0%");
+}
 
-    if (texture == NULL) {
-        return;
-    }
+// Runs the solver for a slice of the frame, then plays its moves back at a
+// steady rate. Turning the cube by hand drops whatever was in progress, since
+// the solution no longer matches the cube
+static void update_solve(Application *app, StateUpdate s_update) {
+    State *state = &app->state;
 
-    for (uint32_t i = 0; i < rect_size; ++i) {
-        texture[i] = clear_color;
+    if (state->cube_turned && state->solve_status != SS_Idle) {
+        stop_solving(app);
     }
+    state->cube_turned = 0;
 
-    generic_write_cube(app->cube.cube, (void *)texture, spacing,
-                       write_color_for_face);
+    if (s_update.toggle_solve) {
+        if (state->solve_status == SS_Idle) {
+            start_solving(app);
+        } else {
+            stop_solving(app);
+        }
+    }
 
-    *p_texture = texture;
-    *p_width = stride;
-    *p_height = height;
-}
+    switch (state->solve_status) {
+    case SS_Idle:
+        break;
+    case SS_Solving: {
+        SolveResult result = solve_step(app->solver, &app->solution,
+                                        SOLVE_SLICE_SECONDS);
+
+        if (result == SR_Failed) {
+            fprintf(stderr, "Could not solve the cube\n");
+            stop_solving(app);
+        } else if (result == SR_Solved) {
+            state->solve_status = SS_Playing;
+            state->solve_index = 0;
+            state->solve_clock = 0.0;
+            set_solve_title(app, "playing solution");
+        } else {
+            int percent = (int)(100.0f * solve_progress(app->solver));
 
-static void set_vec2_uniform(GLuint gl_program, char const *uniform_name,
-                             uint32_t vec_count, float *floats) {
-    GLuint uniform_index = glGetUniformLocation(gl_program, uniform_name);
-    glUniform2fv(uniform_index, vec_count, (GLfloat const *)floats);
-}
+            if (percent != state->solve_percent) {
+                char status[32];
 
-static void set_vec3_uniform(GLuint gl_program, char const *uniform_name,
-                             uint32_t vec_count, float *floats) {
-    GLuint uniform_index = glGetUniformLocation(gl_program, uniform_name);
-    glUniform3fv(uniform_index, vec_count, (GLfloat const *)floats);
-}
+                snprintf(status, sizeof(status), "solving %d%%", percent);
+                set_solve_title(app, status);
+                state->solve_percent = percent;
+            }
+        }
+    } break;
+    case SS_Playing: {
+        uint32_t move_count = app->solution.move_count;
+        double moves_per_sec =
+            DANGEROUS_MAX(PLAYBACK_MOVES_PER_SEC,
+                          move_count / MAX_PLAYBACK_SECONDS);
+
+        state->solve_clock += s_update.delta_time * moves_per_sec;
+        while (state->solve_clock >= 1.0 && state->solve_index < move_count) {
+            queue_turn(&state->turns, app->cube.cube,
+                       app->solution.moves[state->solve_index++]);
+            state->solve_clock -= 1.0;
+        }
 
-static void set_float_uniform(GLuint gl_program, char const *uniform_name,
-                              float f) {
-    GLuint uniform_index = glGetUniformLocation(gl_program, uniform_name);
-    glUniform1f(uniform_index, f);
+        if (state->solve_index == move_count) {
+            stop_solving(app);
+        }
+    } break;
+    }
 }
 
-static void set_cube_uniforms(GLuint gl_program, V3 x_dir, V3 y_dir,
-                              V3 cube_center, uint32_t side_count,
-                              float screen_cube_ratio, V2 dim_vec) {
-    set_vec3_uniform(gl_program, "view_information.x_dir", 1, x_dir.xyz);
-    set_vec3_uniform(gl_program, "view_information.y_dir", 1, y_dir.xyz);
-    set_vec3_uniform(gl_program, "view_information.cube_center", 1,
-                     cube_center.xyz);
-    set_float_uniform(gl_program, "view_information.screen_cube_ratio",
-                      screen_cube_ratio);
-    set_vec2_uniform(gl_program, "view_information.screen_dims", 1, dim_vec.xy);
-    set_float_uniform(gl_program, "side_count", (float)side_count);
+static int same_hover(HoverInformation lhs, HoverInformation rhs) {
+    return lhs.hover_face == rhs.hover_face &&
+           lhs.cube_intersection.x == rhs.cube_intersection.x &&
+           lhs.cube_intersection.y == rhs.cube_intersection.y &&
+           lhs.cube_intersection.z == rhs.cube_intersection.z;
 }
 
-static void get_dirs(V3 x_dir, V3 y_dir, V3 z_dir, V2 *screen_x, V2 *screen_y,
-                     V2 *screen_z) {
-    V3 x = {.x = 1.0f, .y = 0.0f, .z = 0.0f};
-    V3 y = {.x = 0.0f, .y = 1.0f, .z = 0.0f};
-    V3 z = {.x = 0.0f, .y = 0.0f, .z = 1.0f};
+// Lays the cubes out in a grid in the plane the starting camera looks at, as
+// near to square as they fit, with cube 0 in the middle slot
+static int init_scene(Scene *scene, GraphicsCube *cube, uint32_t cube_count) {
+    uint32_t side_count = get_side_count(cube->cube);
+    uint32_t columns = 1, rows, center;
+    float *transforms;
+    float max_offset = 0.0f;
+
+    while (columns * columns < cube_count) {
+        columns += 1;
+    }
+    rows = (cube_count + columns - 1) / columns;
+    center = rows / 2 * columns + columns / 2;
+    if (center >= cube_count) {
+        center = cube_count - 1;
+    }
+
+    scene->cubes = (Cube **)calloc(cube_count, sizeof(Cube *));
+    transforms = (float *)malloc((size_t)cube_count * 4 * sizeof(float));
+    if (scene->cubes == NULL || transforms == NULL) {
+        free(transforms);
+        return -1;
+    }
+
+    scene->cube_count = cube_count;
+    scene->cubes[0] = cube->cube;
+    for (uint32_t k = 1; k < cube_count; ++k) {
+        scene->cubes[k] = new_cube(side_count);
+        if (scene->cubes[k] == NULL) {
+            free(transforms);
+            return -1;
+        }
+    }
+
+    // columns run along y and rows down z, as the starting camera sees them
+    for (uint32_t k = 0; k < cube_count; ++k) {
+        uint32_t slot = (k + center) % cube_count;
+        float y = SCENE_SPACING * ((float)(slot % columns) -
+                                   (float)(center % columns));
+        float z = SCENE_SPACING * ((float)(center / columns) -
+                                   (float)(slot / columns));
+        float offset = sqrtf(y * y + z * z);
+
+        transforms[4 * k + 0] = 0.0f;
+        transforms[4 * k + 1] = y;
+        transforms[4 * k + 2] = z;
+        transforms[4 * k + 3] = 1.0f;
+        max_offset = DANGEROUS_MAX(max_offset, offset);
+    }
+
+    // each cube fits in a ball of radius sqrt(3) < 2 around its center
+    scene->radius = max_offset + 2.0f;
+
+    glGenBuffers(1, &scene->transform_buffer);
+    glGenTextures(1, &scene->transform_texture);
 
-    V3 x_prime = complete_decomp(x, x_dir, y_dir, z_dir);
-    V3 y_prime = complete_decomp(y, x_dir, y_dir, z_dir);
-    V3 z_prime = complete_decomp(z, x_dir, y_dir, z_dir);
+    glBindBuffer(GL_TEXTURE_BUFFER, scene->transform_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, (size_t)cube_count * 4 * sizeof(float),
+                 transforms, GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
 
-    *screen_x = x_prime.xy;
-    *screen_y = y_prime.xy;
-    *screen_z = z_prime.xy;
+    glBindTexture(GL_TEXTURE_BUFFER, scene->transform_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, scene->transform_buffer);
+
+    free(transforms);
+
+    return 0;
 }
 
-static int render_cube(Application const *app, V2 dim_vec) {
-    int ret = 0;
+// Turns the other cubes at random, SCENE_TURNS_PER_SEC between them. Returns
+// whether any of them turned
+static int turn_scene_cubes(Scene *scene, double delta_time) {
+    int turned = 0;
 
-    GLuint gl_program = app->gl_program;
-    uint32_t side_count = get_side_count(app->cube.cube);
+    if (scene->cube_count < 2) {
+        return 0;
+    }
 
-    GraphicsCube const *cube = &app->cube;
+    scene->turn_clock += delta_time * SCENE_TURNS_PER_SEC;
+    while (scene->turn_clock >= 1.0) {
+        Cube *cube = scene->cubes[1 + rand() % (scene->cube_count - 1)];
+        Move move = {
+            .face = rand() % FC_Count,
+            .turns = rand() % 3 + 1,
+            .depth = rand() % get_side_count(cube),
+        };
 
-    Camera const *camera = &app->state.camera;
-    V3 camera_pos = {
-        .rho = camera->rho,
-        .theta = camera->theta,
-        .phi = camera->phi,
-    };
+        apply_move(cube, move);
+        scene->turn_clock -= 1.0;
+        turned = 1;
+    }
 
-    V3 minus_center = polar_to_rectangular(camera_pos);
-    V3 cube_center = scale3(minus_center, -1.0);
-    V3 unit_center = as_unit(cube_center);
-    float screen_cube_ratio = CAMERA_SCREEN_DIST / camera_pos.rho;
+    return turned;
+}
 
-    V3 y_dir_polar = {
-        .rho = 1,
-        .theta =
-            camera_pos.phi >= PI_2 ? camera_pos.theta : camera_pos.theta + PI,
-        .phi = camera_pos.phi >= PI_2 ? camera_pos.phi - PI_2
-                                      : PI_2 - camera_pos.phi,
-    };
-    V3 y_dir = polar_to_rectangular(y_dir_polar);
-    V3 x_dir = cross(unit_center, y_dir);
+// Whether the sticker path can draw the cube
+static int has_sticker_colors(GraphicsCube const *cube) {
+    return cube->color_staging != NULL;
+}
 
-    Color *texture = NULL;
-    uint32_t tex_width, tex_height;
+// Whether any rows of the cube changed since they were last drawn
+static int cube_changed(Cube *cube) {
+    RowRange rows[FC_Count];
 
-    GLuint uniform_index;
+    get_dirty_rows(cube, rows);
+    for (FaceColor fc = 0; fc < FC_Count; ++fc) {
+        if (rows[fc].first <= rows[fc].last) {
+            return 1;
+        }
+    }
 
-    V3 mouse_3 = {
-        .x = app->state.mouse.x,
-        .y = app->state.mouse.y,
-        .z = CAMERA_SCREEN_DIST,
-    };
-    V3 mouse_in_world = compose(mouse_3, x_dir, y_dir, unit_center);
+    return 0;
+}
+
+static void update(Application *app, StateUpdate s_update) {
+    State *state = &app->state;
+
+    // what the last frame was drawn from
+    Camera camera = state->camera;
+    HoverInformation hover = state->hover_info;
+    int hover_found = state->cube_intersection_found;
+    int turning = state->turns.count > 0;
 
-    V2 screen_x, screen_y, screen_z;
-    get_dirs(x_dir, y_dir, unit_center, &screen_x, &screen_y, &screen_z);
+    // without a sticker buffer there is only the face path
+    if (!has_sticker_colors(&app->cube)) {
+        s_update.toggle_render_path = 0;
+    }
 
-    VertexAttributes *attributes =
-        ARENA_PUSH_N(VertexAttributes, app->arena, cube->vertex_count);
-    if (attributes == NULL) {
-        fprintf(stderr, "Couldn't allocate space for vertex attribute array\n");
-        goto vertex_alloc_fail;
+    update_from_user_input(state, app->cube.cube, s_update);
+    update_intersection_info(state, &app->cube, app->scene.radius,
+                             s_update.toggle_mouse_click);
+    update_solve(app, s_update);
+    advance_turns(&state->turns, app->cube.cube, s_update.delta_time);
+    if (turn_scene_cubes(&app->scene, s_update.delta_time)) {
+        state->needs_redraw = 1;
+    }
+
+    // a turn that was moving last frame needs one more to be drawn finished
+    if (s_update.window_resized || s_update.window_exposed ||
+        s_update.toggle_render_path || turning || state->turns.count > 0 ||
+        camera.rho != state->camera.rho ||
+        camera.theta != state->camera.theta ||
+        camera.phi != state->camera.phi ||
+        hover_found != (int)state->cube_intersection_found ||
+        (hover_found && !same_hover(hover, state->hover_info)) ||
+        cube_changed(app->cube.cube)) {
+        state->needs_redraw = 1;
     }
 
     if (print_a_thing) {
-        printf("mouse_2 = {.x = %f, .y = %f},\nmouse_3 = {.x = %f, .y = %f, .z "
-               "= %f}\nmouse_in_world = {.x = "
-               "%f, .y = %f, .z = %f}\n\n",
-               app->state.mouse.x, app->state.mouse.y, mouse_3.x, mouse_3.y,
-               mouse_3.z, mouse_in_world.x, mouse_in_world.y, mouse_in_world.z);
-    }
-
-    // TODO: figure out if there is a better way to clear this, since these are
-    // all floats... try to figure out how to pass integers into the buffer
-    // without breaking everything
-    for (uint32_t ind = 0; ind < cube->vertex_count; ++ind) {
-        attributes[ind].intersecting = 0.0f;
-    }
-
-    if (app->state.cube_intersection_found) {
-        for (uint32_t ind = 0; ind < cube->index_count; ind += 6) {
-            int ind00 = cube->indices[ind + 0];
-            int ind01 = cube->indices[ind + 1];
-            int ind02 = cube->indices[ind + 2];
-            int ind10 = cube->indices[ind + 3];
-            int ind11 = cube->indices[ind + 4];
-            int ind12 = cube->indices[ind + 5];
-
-            if ((FaceColor)cube->info[ind00].face_num !=
-                app->state.hover_info.hover_face) {
-                // can skip this one because we aren't even looking at the right
-                // face
-                continue;
-            }
+        printf(
+            "\nScreen dirs:\n"
+            "x_axis = {.x = %f, .y = %f}\n"
+            "y_axis = {.x = %f, .y = %f}\n"
+            "z_axis = {.x = %f, .y = %f}\n",
+            state->basis_info.screen_x_dir.x, state->basis_info.screen_x_dir.y,
+            state->basis_info.screen_y_dir.x, state->basis_info.screen_y_dir.y,
+            state->basis_info.screen_z_dir.x, state->basis_info.screen_z_dir.y);
+    }
 
-            V3 minus_a0 = scale3(cube->info[ind00].position, -1.0f);
-            V3 minus_a1 = scale3(cube->info[ind10].position, -1.0f);
-
-            int is_intersecting_triangle0 = inside_triangle(
-                add3(app->state.hover_info.cube_intersection, minus_a0),
-                add3(cube->info[ind01].position, minus_a0),
-                add3(cube->info[ind02].position, minus_a0));
-
-            int is_intersecting_triangle1 = inside_triangle(
-                add3(app->state.hover_info.cube_intersection, minus_a1),
-                add3(cube->info[ind11].position, minus_a1),
-                add3(cube->info[ind12].position, minus_a1));
-
-            if (is_intersecting_triangle0 || is_intersecting_triangle1) {
-                V3 a0 = cube->info[ind00].position;
-                V3 b0 = cube->info[ind01].position;
-                V3 c0 = cube->info[ind02].position;
-                V3 a1 = cube->info[ind10].position;
-                V3 b1 = cube->info[ind11].position;
-                V3 c1 = cube->info[ind12].position;
-
-                if (print_a_thing) {
-                    printf(
-                        "Intersection with:\n"
-                        "closest_intersection = {.x = %f, .y = %f, .z = %f}\n"
-                        "a0 = {.x = %f, .y = %f, .z = %f}\nb0 = {.x = %f, .y = "
-                        "%f, .z = %f}\nc0 = {.x = %f, .y = %f, .z = %f}\n"
-                        "a1 = {.x = %f, .y = %f, .z = %f}\nb1 = {.x = %f, .y = "
-                        "%f, .z = %f}\nc1 = {.x = %f, .y = %f, .z = %f}\n\n",
-                        app->state.hover_info.cube_intersection.x,
-                        app->state.hover_info.cube_intersection.y,
-                        app->state.hover_info.cube_intersection.z, a0.x, a0.y,
-                        a0.z, b0.x, b0.y, b0.z, c0.x, c0.y, c0.z, a1.x, a1.y,
-                        a1.z, b1.x, b1.y, b1.z, c1.x, c1.y, c1.z);
-                }
+    // a frame after waiting for events took as long as the wait did
+    if (!s_update.after_wait) {
+        record_frame(&app->frame_stats, s_update.delta_time);
+    }
+    if (s_update.toggle_recording) {
+        if (app->capture.recording == NULL) {
+            start_recording(&app->capture);
+        } else {
+            stop_recording(&app->capture);
+        }
+        state->recording = app->capture.recording != NULL;
+    }
 
-                attributes[ind00].intersecting = 1.0f;
-                attributes[ind01].intersecting = 1.0f;
-                attributes[ind02].intersecting = 1.0f;
-                attributes[ind10].intersecting = 1.0f;
-                attributes[ind11].intersecting = 1.0f;
-                attributes[ind12].intersecting = 1.0f;
-            }
+    if (s_update.take_screenshot) {
+        state->screenshot_requested = 1;
+    }
+
+    // a recording has every frame in it, whether or not anything moved
+    if (state->recording || state->screenshot_requested) {
+        state->needs_redraw = 1;
+    }
+
+    if (s_update.dump_frame_stats) {
+        write_frame_stats(stdout, &app->frame_stats);
+        printf("rendering at %.2f of the window's size\n",
+               state->dynamic_resolution ? app->scaled.scale : 1.0f);
+    }
+
+    app->last_counter = s_update.counter;
+}
+
+static void clear_row_ranges(RowRange *rows, uint32_t side_count,
+                             uint32_t faces) {
+    for (FaceColor fc = 0; fc < FC_Count; ++fc) {
+        if (faces & (1u << fc)) {
+            rows[fc] = (RowRange){.first = side_count, .last = 0};
         }
     }
+}
+
+// Faces are cut into as few tiles as the texture size limit allows, and there
+// have to be enough layers for all of them
+static int init_cube_texture(GraphicsCube *cube) {
+    uint32_t side_count = get_side_count(cube->cube);
+    GLint max_size, max_layers;
+    uint32_t tiles, layers;
+    size_t sticker_count = (size_t)FC_Count * side_count * side_count;
+
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
 
-    create_texture_from_cube(app, &texture, &tex_width, &tex_height);
-    if (texture == NULL) {
-        fprintf(stderr, "Couldn't allocate space for cube texture\n");
-        goto texture_alloc_fail;
+    tiles = (side_count + (uint32_t)max_size - 1) / (uint32_t)max_size;
+    layers = FC_Count * tiles * tiles;
+    if (layers > (uint32_t)max_layers) {
+        return -1;
     }
 
-    glBindVertexArray(cube->vao);
+    cube->tiles_per_side = tiles;
+    cube->tile_size = (side_count + tiles - 1) / tiles;
+
+    cube->regions = (TileRegion *)malloc(layers * sizeof(TileRegion));
+    if (cube->regions == NULL) {
+        return -1;
+    }
 
-    glActiveTexture(GL_TEXTURE0);
-    uniform_index = glGetUniformLocation(gl_program, "cube_texture");
-    glUniform1i(uniform_index, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-
-    set_cube_uniforms(gl_program, x_dir, y_dir, cube_center, side_count,
-                      screen_cube_ratio, dim_vec);
-
-    glBindTexture(GL_TEXTURE_2D, cube->texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, tex_width, tex_height, 0, GL_RGB,
-                 GL_UNSIGNED_BYTE, texture);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    // fill vertex information buffer
-    glBindBuffer(GL_ARRAY_BUFFER, cube->vbo[0]);
-    glBufferData(GL_ARRAY_BUFFER, cube->vertex_count * sizeof(*cube->info),
-                 (void const *)cube->info, GL_STATIC_DRAW);
-
-    // specify location of data within buffer
-    glVertexAttribPointer(
-        0, 3, GL_FLOAT, GL_FALSE, sizeof(*cube->info),
-        (GLvoid const *)offsetof(VertexInformation, position));
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(
-        1, 1, GL_FLOAT, GL_FALSE, sizeof(*cube->info),
-        (GLvoid const *)offsetof(VertexInformation, face_num));
-    glEnableVertexAttribArray(1);
-
-    // fill vertex information buffer
-    glBindBuffer(GL_ARRAY_BUFFER, cube->vbo[1]);
-    glBufferData(GL_ARRAY_BUFFER, cube->vertex_count * sizeof(*attributes),
-                 (void const *)attributes, GL_STATIC_DRAW);
-
-    // specify location of data within buffer
-    glVertexAttribPointer(
-        2, 1, GL_FLOAT, GL_FALSE, sizeof(*attributes),
-        (GLvoid const *)offsetof(VertexAttributes, intersecting));
-    glEnableVertexAttribArray(2);
-
-    // fill index buffer
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cube->ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                 cube->index_count * sizeof(*cube->indices),
-                 (void const *)cube->indices, GL_STATIC_DRAW);
-
-    glDrawElements(GL_TRIANGLES, cube->index_count, GL_UNSIGNED_INT,
-                   (void const *)0);
+    // rows of single byte texels are not padded to 4 bytes
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-    return ret;
+    // nothing is filled in here, the cube starts with every row dirty
+    glBindTexture(GL_TEXTURE_2D_ARRAY, cube->texture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8UI, cube->tile_size,
+                 cube->tile_size, layers, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE,
+                 NULL);
 
-texture_alloc_fail:
-    ret += 1;
+    // at least a row of a tile, so that every round gets somewhere
+    cube->pbo_size = DANGEROUS_MIN(
+        sticker_count, DANGEROUS_MAX(TEXTURE_PBO_BYTES, cube->tile_size));
+    for (uint32_t i = 0; i < TEXTURE_PBO_COUNT; ++i) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, cube->pbo[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, cube->pbo_size, NULL,
+                     GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    cube->next_pbo = 0;
 
-vertex_alloc_fail:
-    ret += 1;
-    return ret;
+    return 0;
 }
 
-static void render(Application const *app) {
-    // TODO: Get the screen width and height and use a "pixels to meters" type
-    // thing like from Handmade Hero?
+// Packs the first `region_count` regions, `size` bytes of them, into the next
+// pixel buffer and sends them to the texture
+static int upload_tile_regions(GraphicsCube *cube, uint32_t region_count,
+                               size_t size) {
+    uint32_t side_count = get_side_count(cube->cube);
+    uint32_t tile_size = cube->tile_size;
+    uint32_t tiles = cube->tiles_per_side;
+    FaceColor const *squares = get_squares(cube->cube);
+    unsigned char *mapped;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, cube->pbo[cube->next_pbo]);
+    cube->next_pbo = (cube->next_pbo + 1) % TEXTURE_PBO_COUNT;
+
+    mapped = (unsigned char *)glMapBufferRange(
+        GL_PIXEL_UNPACK_BUFFER, 0, size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (mapped == NULL) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return -1;
+    }
 
-    V2 dim_vec = {
-        .x = (float)app->state.window_width,
-        .y = (float)app->state.window_height,
-    };
+    for (uint32_t i = 0; i < region_count; ++i) {
+        TileRegion region = cube->regions[i];
+        uint32_t face = region.layer / (tiles * tiles);
+        uint32_t tr = (region.layer / tiles) % tiles;
+        uint32_t tc = region.layer % tiles;
+        unsigned char *dst = mapped + region.offset;
 
-    glViewport(0, 0, app->state.window_width, app->state.window_height);
+        for (uint32_t y = 0; y < region.height; ++y) {
+            uint32_t row = tr * tile_size + region.y + y;
+            FaceColor const *src = squares +
+                                   ((size_t)face * side_count + row) *
+                                       side_count +
+                                   tc * tile_size;
 
-    if (arena_begin(app->arena) == 0) {
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            for (uint32_t x = 0; x < region.width; ++x) {
+                *dst++ = (unsigned char)src[x];
+            }
+        }
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
 
-        // TODO: maybe write some wrappers for this?
-        if (render_cube(app, dim_vec) != 0) {
-            goto skip_render;
+    glBindTexture(GL_TEXTURE_2D_ARRAY, cube->texture);
+    for (uint32_t i = 0; i < region_count; ++i) {
+        TileRegion region = cube->regions[i];
+
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, region.x, region.y,
+                        region.layer, region.width, region.height, 1,
+                        GL_RED_INTEGER, GL_UNSIGNED_BYTE,
+                        (void const *)(uintptr_t)region.offset);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    return 0;
+}
+
+// Sends the rows of each of `faces` that changed since the last upload, cut
+// along the tiles they cross and packed one region after another into pixel
+// buffers. A region is cut again wherever a buffer fills up, and the full
+// buffer is sent before the next one is packed. Frames without moves leave the
+// texture alone
+static int update_cube_texture(GraphicsCube *cube, uint32_t faces) {
+    uint32_t side_count = get_side_count(cube->cube);
+    uint32_t tile_size = cube->tile_size;
+    uint32_t tiles = cube->tiles_per_side;
+    uint32_t max_regions = FC_Count * tiles * tiles;
+
+    uint32_t region_count = 0;
+    size_t offset = 0;
+
+    for (FaceColor fc = 0; fc < FC_Count; ++fc) {
+        RowRange rows = cube->texture_dirty[fc];
+
+        if (!(faces & (1u << fc)) || rows.first > rows.last) {
+            continue;
         }
 
-        SDL_GL_SwapWindow(app->window);
+        for (uint32_t tr = rows.first / tile_size; tr <= rows.last / tile_size;
+             ++tr) {
+            uint32_t first = DANGEROUS_MAX(rows.first, tr * tile_size);
+            uint32_t last = DANGEROUS_MIN(rows.last, (tr + 1) * tile_size - 1);
+
+            for (uint32_t tc = 0; tc < tiles; ++tc) {
+                uint32_t col = tc * tile_size;
+                uint32_t width = DANGEROUS_MIN(tile_size, side_count - col);
+                uint32_t row = first;
+
+                while (row <= last) {
+                    size_t room = (cube->pbo_size - offset) / width;
+                    TileRegion *region = cube->regions + region_count;
+
+                    if (room == 0 || region_count == max_regions) {
+                        if (upload_tile_regions(cube, region_count, offset) !=
+                            0) {
+                            return -1;
+                        }
+                        region_count = 0;
+                        offset = 0;
+                        continue;
+                    }
+
+                    region->layer = (fc * tiles + tr) * tiles + tc;
+                    region->x = 0;
+                    region->y = row - tr * tile_size;
+                    region->width = width;
+                    region->height =
+                        (uint32_t)DANGEROUS_MIN(room, (size_t)last - row + 1);
+                    region->offset = offset;
+
+                    offset += (size_t)region->width * region->height;
+                    row += region->height;
+                    region_count += 1;
+                }
+            }
+        }
+    }
 
-    skip_render:
-        arena_pop(app->arena);
+    if (region_count > 0 &&
+        upload_tile_regions(cube, region_count, offset) != 0) {
+        return -1;
     }
+
+    clear_row_ranges(cube->texture_dirty, side_count, faces);
+
+    return 0;
 }
 
-static void define_split_vertices(Arena *arena, uint32_t cube_size,
-                                  GraphicsCube *cube) {
-    uint32_t split_vertex_count =
-        CUBE_FACES * (2 * cube_size) * (2 * cube_size);
+// One byte per sticker in storage order, read by the sticker shader through a
+// buffer texture. A dirty range of rows is one contiguous run of stickers.
+// The scene's cubes follow each other in it. A single cube too big for a
+// buffer texture goes without, and is only drawn by the face path
+static int init_sticker_colors(GraphicsCube *cube, uint32_t cube_count) {
+    uint32_t side_count = get_side_count(cube->cube);
+    size_t sticker_count =
+        (size_t)cube_count * FC_Count * side_count * side_count;
+    GLint max_texels;
+
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+    if (sticker_count > (size_t)max_texels) {
+        if (cube_count == 1) {
+            return 0;
+        }
+
+        fprintf(stderr,
+                "%u cubes of %u sides have %zu stickers, a scene can't have "
+                "more than %d, try fewer sides or cubes\n",
+                cube_count, side_count, sticker_count, max_texels);
+        return -1;
+    }
 
-    double factor = 1.0 / (double)cube_size;
+    cube->color_staging = (uint8_t *)malloc(sticker_count);
+    if (cube->color_staging == NULL) {
+        return -1;
+    }
 
-    cube->vertex_count = split_vertex_count;
-    cube->info = ARENA_PUSH_N(VertexInformation, arena, split_vertex_count);
+    glBindBuffer(GL_TEXTURE_BUFFER, cube->color_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, sticker_count, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
 
-    uint32_t cur_index = 0;
-    for (uint32_t face_id = 0; face_id < CUBE_FACES; ++face_id) {
-        int const *cube_indices = face_indices + (face_id * SQUARE_CORNERS);
+    glBindTexture(GL_TEXTURE_BUFFER, cube->color_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R8UI, cube->color_buffer);
 
-        V3 start = cube_vertices[cube_indices[0]];
-        V3 final = cube_vertices[cube_indices[2]];
+    return 0;
+}
 
-        V3 target_one = cube_vertices[cube_indices[1]];
-        V3 target_two = cube_vertices[cube_indices[3]];
+// Uploads the `rows` of `source`'s `faces` to the stickers from `offset` on
+static void upload_sticker_rows(GraphicsCube *cube, Cube *source,
+                                size_t offset, RowRange const *rows,
+                                uint32_t faces) {
+    uint32_t side_count = get_side_count(source);
+    FaceColor const *squares = get_squares(source);
+    uint8_t *staging = cube->color_staging + offset;
 
-        // bottom left
-        cube->info[cur_index++] = (VertexInformation){
-            .position = start,
-            .face_num = (float)face_id,
-        };
+    glBindBuffer(GL_TEXTURE_BUFFER, cube->color_buffer);
+    for (FaceColor fc = 0; fc < FC_Count; ++fc) {
+        uint32_t first, count;
 
-        // left side
-        for (uint32_t x_i = 1; x_i < cube_size; ++x_i) {
-            // two of them to allow for rotation
-            cube->info[cur_index++] = (VertexInformation){
-                .position = v_lerp(start, x_i * factor, target_one),
-                .face_num = (float)face_id,
-            };
+        if (!(faces & (1u << fc)) || rows[fc].first > rows[fc].last) {
+            continue;
+        }
 
-            // (the second)
-            cube->info[cur_index++] = (VertexInformation){
-                .position = v_lerp(start, x_i * factor, target_one),
-                .face_num = (float)face_id,
-            };
+        first = (fc * side_count + rows[fc].first) * side_count;
+        count = (rows[fc].last - rows[fc].first + 1) * side_count;
+        for (uint32_t i = first; i < first + count; ++i) {
+            staging[i] = (uint8_t)squares[i];
         }
+        glBufferSubData(GL_TEXTURE_BUFFER, offset + first, count,
+                        (void const *)(staging + first));
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
 
-        // top left
-        cube->info[cur_index++] = (VertexInformation){
-            .position = target_one,
-            .face_num = (float)face_id,
-        };
+static void update_sticker_colors(GraphicsCube *cube, uint32_t faces) {
+    uint32_t side_count = get_side_count(cube->cube);
 
-        for (uint32_t y_i = 1; y_i < cube_size; ++y_i) {
-            // two of them to allow for rotation
-            {
-                V3 inner_start = v_lerp(start, y_i * factor, target_two);
-                V3 inner_target_one = v_lerp(target_one, y_i * factor, final);
+    upload_sticker_rows(cube, cube->cube, 0, cube->colors_dirty, faces);
+    clear_row_ranges(cube->colors_dirty, side_count, faces);
+}
 
-                cube->info[cur_index++] = (VertexInformation){
-                    .position = inner_start,
-                    .face_num = (float)face_id,
-                };
+// The other cubes are always drawn whole, cube 0 goes through
+// update_sticker_colors with the rest of the GraphicsCube
+static void update_scene_colors(GraphicsCube *cube, Scene const *scene) {
+    uint32_t side_count = get_side_count(cube->cube);
+    size_t cube_stickers = (size_t)FC_Count * side_count * side_count;
 
-                for (uint32_t x_i = 1; x_i < cube_size; ++x_i) {
-                    // two of them to allow for rotation
-                    cube->info[cur_index++] = (VertexInformation){
-                        .position =
-                            v_lerp(inner_start, x_i * factor, inner_target_one),
-                        .face_num = (float)face_id,
-                    };
-
-                    // (the second)
-                    cube->info[cur_index++] = (VertexInformation){
-                        .position =
-                            v_lerp(inner_start, x_i * factor, inner_target_one),
-                        .face_num = (float)face_id,
-                    };
-                }
+    for (uint32_t k = 1; k < scene->cube_count; ++k) {
+        RowRange rows[FC_Count];
 
-                cube->info[cur_index++] = (VertexInformation){
-                    .position = inner_target_one,
-                    .face_num = (float)face_id,
-                };
-            }
+        get_dirty_rows(scene->cubes[k], rows);
+        upload_sticker_rows(cube, scene->cubes[k], k * cube_stickers, rows,
+                            ALL_FACES);
+        clear_dirty_rows(scene->cubes[k]);
+    }
+}
 
-            // (the second)
-            {
-                V3 inner_start = v_lerp(start, y_i * factor, target_two);
-                V3 inner_target_one = v_lerp(target_one, y_i * factor, final);
+// the first sticker row, or column, in summary row `y`
+static uint32_t summary_start(uint32_t y, uint32_t side_count,
+                              uint32_t summary_size) {
+    return (uint32_t)(((uint64_t)y * side_count + summary_size - 1) /
+                      summary_size);
+}
 
-                cube->info[cur_index++] = (VertexInformation){
-                    .position = inner_start,
-                    .face_num = (float)face_id,
-                };
+static int init_cube_summary(GraphicsCube *cube) {
+    uint32_t side_count = get_side_count(cube->cube);
+    uint32_t size = SUMMARY_SIZE;
+    size_t texels = (size_t)FC_Count * size * size;
+    size_t sticker_count = (size_t)FC_Count * side_count * side_count;
 
-                for (uint32_t x_i = 1; x_i < cube_size; ++x_i) {
-                    // two of them to allow for rotation
-                    cube->info[cur_index++] = (VertexInformation){
-                        .position =
-                            v_lerp(inner_start, x_i * factor, inner_target_one),
-                        .face_num = (float)face_id,
-                    };
-
-                    // (the second)
-                    cube->info[cur_index++] = (VertexInformation){
-                        .position =
-                            v_lerp(inner_start, x_i * factor, inner_target_one),
-                        .face_num = (float)face_id,
-                    };
+    cube->summary_size = 0;
+    if (side_count <= size) {
+        return 0;
+    }
+
+    cube->summary_counts =
+        (uint32_t *)calloc(texels * FC_Count, sizeof(uint32_t));
+    cube->summary_seen = (uint8_t *)malloc(sticker_count);
+    cube->summary_texels = (uint8_t *)calloc(texels * 2, 4);
+    if (cube->summary_counts == NULL || cube->summary_seen == NULL ||
+        cube->summary_texels == NULL) {
+        return -1;
+    }
+
+    // nothing has been counted yet, every sticker is new
+    memset(cube->summary_seen, 0xFF, sticker_count);
+    cube->summary_size = size;
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, cube->summary_texture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, size, size, 2 * FC_Count,
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    return 0;
+}
+
+// Only stickers that changed since they were last seen move a count, then the
+// summary rows over the dirty rows are worked out again and sent
+static void update_cube_summary(GraphicsCube *cube, uint32_t faces) {
+    uint32_t side_count = get_side_count(cube->cube);
+    uint32_t size = cube->summary_size;
+    FaceColor const *squares = get_squares(cube->cube);
+
+    for (FaceColor fc = 0; fc < FC_Count; ++fc) {
+        RowRange rows = cube->summary_dirty[fc];
+        uint32_t first_y, last_y;
+        size_t layer_bytes = (size_t)size * size * 4;
+        uint8_t *face_texels = cube->summary_texels + 2 * fc * layer_bytes;
+
+        if (!(faces & (1u << fc)) || rows.first > rows.last) {
+            continue;
+        }
+
+        for (uint32_t r = rows.first; r <= rows.last; ++r) {
+            uint32_t y = (uint32_t)((uint64_t)r * size / side_count);
+            size_t row_start = ((size_t)fc * side_count + r) * side_count;
+            uint32_t *row_counts = cube->summary_counts +
+                                   ((size_t)fc * size + y) * size * FC_Count;
+
+            for (uint32_t c = 0; c < side_count; ++c) {
+                uint8_t new_color = (uint8_t)squares[row_start + c];
+                uint8_t old_color = cube->summary_seen[row_start + c];
+                uint32_t *counts;
+
+                if (new_color == old_color) {
+                    continue;
                 }
 
-                cube->info[cur_index++] = (VertexInformation){
-                    .position = inner_target_one,
-                    .face_num = (float)face_id,
-                };
+                counts = row_counts +
+                         (uint64_t)c * size / side_count * FC_Count;
+                if (old_color < FC_Count) {
+                    counts[old_color] -= 1;
+                }
+                counts[new_color] += 1;
+                cube->summary_seen[row_start + c] = new_color;
             }
         }
 
-        // bottom right
-        cube->info[cur_index++] = (VertexInformation){
-            .position = target_two,
-            .face_num = (float)face_id,
-        };
+        first_y = (uint32_t)((uint64_t)rows.first * size / side_count);
+        last_y = (uint32_t)((uint64_t)rows.last * size / side_count);
+        for (uint32_t y = first_y; y <= last_y; ++y) {
+            uint32_t height = summary_start(y + 1, side_count, size) -
+                              summary_start(y, side_count, size);
+
+            for (uint32_t x = 0; x < size; ++x) {
+                uint32_t width = summary_start(x + 1, side_count, size) -
+                                 summary_start(x, side_count, size);
+                uint32_t area = width * height;
+                uint32_t const *counts =
+                    cube->summary_counts +
+                    (((size_t)fc * size + y) * size + x) * FC_Count;
+
+                for (uint32_t k = 0; k < FC_Count; ++k) {
+                    uint8_t *texel = face_texels + (k / 4) * layer_bytes +
+                                     ((size_t)y * size + x) * 4;
+
+                    texel[k % 4] =
+                        (uint8_t)((counts[k] * 255ull + area / 2) / area);
+                }
+            }
+        }
 
-        // right side
-        for (uint32_t x_i = 1; x_i < cube_size; ++x_i) {
-            // two of them to allow for rotation
-            cube->info[cur_index++] = (VertexInformation){
-                .position = v_lerp(target_two, x_i * factor, final),
-                .face_num = (float)face_id,
-            };
+        glBindTexture(GL_TEXTURE_2D_ARRAY, cube->summary_texture);
+        for (uint32_t layer = 0; layer < 2; ++layer) {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, first_y,
+                            2 * fc + layer, size, last_y - first_y + 1, 1,
+                            GL_RGBA, GL_UNSIGNED_BYTE,
+                            (void const *)(face_texels + layer * layer_bytes +
+                                           (size_t)first_y * size * 4));
+        }
+    }
 
-            // (the second)
-            cube->info[cur_index++] = (VertexInformation){
-                .position = v_lerp(target_two, x_i * factor, final),
-                .face_num = (float)face_id,
-            };
+    clear_row_ranges(cube->summary_dirty, side_count, faces);
+}
+
+static void merge_row_ranges(RowRange *into, RowRange const *from) {
+    for (FaceColor fc = 0; fc < FC_Count; ++fc) {
+        if (from[fc].first > from[fc].last) {
+            continue;
+        }
+        if (into[fc].first > into[fc].last) {
+            into[fc] = from[fc];
+            continue;
         }
 
-        // top right
-        cube->info[cur_index++] = (VertexInformation){
-            .position = final,
-            .face_num = (float)face_id,
-        };
+        into[fc].first = DANGEROUS_MIN(into[fc].first, from[fc].first);
+        into[fc].last = DANGEROUS_MAX(into[fc].last, from[fc].last);
     }
+}
+
+// Both render paths keep their own copy of the cube, so the rows changed since
+// the last frame are handed to each of them and only the one drawing this
+// frame catches up, and only on the faces in view. The rest wait until they
+// are drawn
+static void collect_dirty_rows(GraphicsCube *cube) {
+    RowRange rows[FC_Count];
+
+    get_dirty_rows(cube->cube, rows);
+    clear_dirty_rows(cube->cube);
+
+    merge_row_ranges(cube->texture_dirty, rows);
+    merge_row_ranges(cube->colors_dirty, rows);
+    merge_row_ranges(cube->summary_dirty, rows);
+}
+
+// One write per frame, to the buffer bound to the ViewInformation block. The
+// shader works out which sticker the hovered point is on itself, so `hover`
+// costs the same at any size. It is NULL when the mouse is off the cube
+// `turn` is the move being animated, if any, `progress` of the way through
+static void set_cube_uniforms(GLuint view_ubo, M4 view_projection,
+                              uint32_t side_count, uint32_t tile_size,
+                              HoverInformation const *hover, int use_summary,
+                              Move const *turn, double progress) {
+    ViewUniforms uniforms = {
+        .view_projection = view_projection,
+        .hover_point = hover != NULL ? hover->cube_intersection : (V3){{{0}}},
+        .side_count = (float)side_count,
+        .hover_face = hover != NULL ? (int32_t)hover->hover_face : -1,
+        .use_summary = use_summary,
+        .tile_size = (int32_t)tile_size,
+        .turn_depth = -1,
+    };
 
-    if (cur_index != split_vertex_count) {
-        fprintf(stderr, "Wrong vertex count\n");
+    if (turn != NULL) {
+        // clockwise seen from the face is the negative way about its normal
+        int quarters = turn->turns == 3 ? -1 : (int)turn->turns;
+        uniforms.turn_axis = face_normals[turn->face];
+        uniforms.turn_angle = (float)(-quarters * PI_2 * progress);
+        uniforms.turn_depth = (int32_t)turn->depth;
     }
 
-#if 1
-    for (uint32_t i = 0; i < cur_index / CUBE_FACES; ++i) {
-        printf("cube->info[%d] = { .position = { .x = %f, .y = %f, .z = %f }, "
-               ".face_num = %d }\n",
-               i, cube->info[i].position.x, cube->info[i].position.y,
-               cube->info[i].position.z, (int)cube->info[i].face_num);
+    glBindBuffer(GL_UNIFORM_BUFFER, view_ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(uniforms),
+                    (void const *)&uniforms);
+}
+
+static int render_cube(Application *app, V2 dim_vec) {
+    int ret = 0;
+
+    uint32_t side_count = get_side_count(app->cube.cube);
+
+    GraphicsCube *cube = &app->cube;
+    Scene const *scene = &app->scene;
+    HoverInformation const *hover_info =
+        app->state.cube_intersection_found ? &app->state.hover_info : NULL;
+
+    // worked out in update, from this frame's camera
+    BasisInformation const *basis = &app->state.basis_info;
+    V3 cube_center = scale3(basis->eye, -1.0f);
+
+    // a face's edge is about screen_cube_ratio of the window's diagonal
+    float sticker_pixels =
+        basis->screen_cube_ratio * sqrtf(dot2(dim_vec, dim_vec)) / side_count;
+    int use_summary = scene->cube_count == 1 && cube->summary_size != 0 &&
+                      sticker_pixels < LOD_STICKER_PIXELS;
+
+    // A turn is drawn by the sticker path, which can move a layer's stickers
+    // on their own. A turning layer shows faces that are otherwise hidden.
+    // Stickers too small to see, or a cube without a sticker buffer, are drawn
+    // as they were before the turn and catch up once it ends
+    TurnQueue const *turns = &app->state.turns;
+    Move const *turn = turns->count > 0 && !use_summary &&
+                               has_sticker_colors(cube)
+                           ? &turns->moves[turns->first]
+                           : NULL;
+
+    // at most three faces are in view, each face's vertices start at
+    // face * FACE_VERTICES. The other cubes in a scene see different ones
+    uint32_t visible = turn != NULL || scene->cube_count > 1
+                           ? ALL_FACES
+                           : get_visible_faces(cube_center);
+    GLint firsts[CUBE_FACES];
+    GLsizei counts[CUBE_FACES];
+    GLsizei draw_count = 0;
+
+    for (int face = 0; face < CUBE_FACES; ++face) {
+        if (visible & (1u << face)) {
+            firsts[draw_count] = face * FACE_VERTICES;
+            counts[draw_count] = FACE_VERTICES;
+            draw_count += 1;
+        }
     }
-#endif
+
+    collect_dirty_rows(cube);
+
+    glBindVertexArray(cube->vao);
+
+    set_cube_uniforms(app->view_ubo, basis->view_projection, side_count,
+                      cube->tile_size, hover_info, use_summary, turn,
+                      turns->progress);
+
+    if (use_summary) {
+        update_cube_summary(cube, visible);
+
+        glUseProgram(app->gl_program);
+        glActiveTexture(GL_TEXTURE0 + SUMMARY_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, cube->summary_texture);
+
+        // the same quads as the face path, whatever the size
+        glMultiDrawArrays(GL_TRIANGLE_STRIP, firsts, counts, draw_count);
+    } else if (turn != NULL || scene->cube_count > 1 ||
+               app->state.render_path == RP_Stickers) {
+        update_sticker_colors(cube, visible);
+        update_scene_colors(cube, scene);
+
+        glUseProgram(app->sticker_program);
+        glActiveTexture(GL_TEXTURE0 + STICKER_COLOR_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, cube->color_texture);
+        glActiveTexture(GL_TEXTURE0 + CUBE_TRANSFORM_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, scene->transform_texture);
+
+        // one quad per sticker, placed from gl_InstanceID on the face that
+        // gl_VertexID starts at, for every cube in the scene
+        for (uint32_t i = 0; i < draw_count; ++i) {
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, firsts[i], FACE_VERTICES,
+                                  side_count * side_count *
+                                      scene->cube_count);
+        }
+
+        if (turn != NULL) {
+            // the insides of the cube the turning layer opens up
+            GLint cap_firsts[TURN_CAPS];
+            GLsizei cap_counts[TURN_CAPS];
+            for (int cap = 0; cap < TURN_CAPS; ++cap) {
+                cap_firsts[cap] = (CUBE_FACES + cap) * FACE_VERTICES;
+                cap_counts[cap] = FACE_VERTICES;
+            }
+
+            glMultiDrawArrays(GL_TRIANGLE_STRIP, cap_firsts, cap_counts,
+                              TURN_CAPS);
+        }
+    } else {
+        if (update_cube_texture(cube, visible) != 0) {
+            fprintf(stderr, "Couldn't map a buffer for the cube texture\n");
+            goto texture_update_fail;
+        }
+
+        glUseProgram(app->gl_program);
+        glActiveTexture(GL_TEXTURE0 + CUBE_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, cube->texture);
+
+        // the vertex shader makes the corners of each face from gl_VertexID,
+        // so there is nothing to read from buffers
+        glMultiDrawArrays(GL_TRIANGLE_STRIP, firsts, counts, draw_count);
+    }
+
+    return ret;
+
+texture_update_fail:
+    ret += 1;
+    return ret;
 }
 
-static void define_split_indices(Arena *arena, uint32_t cube_size,
-                                 GraphicsCube *cube) {
-    uint32_t two_cs_m_one = 2 * cube_size - 1;
-    uint32_t expanded_square_vertices =
-        VERTEX_COUNT_TO_TRIANGLE_COUNT(SQUARE_CORNERS);
-    uint32_t index_count_per_side =
-        expanded_square_vertices * (two_cs_m_one * two_cs_m_one);
-    uint32_t split_index_count = CUBE_FACES * index_count_per_side;
-    uint32_t index_stride = 2 * cube_size;
-
-    cube->index_count = split_index_count;
-    cube->indices = ARENA_PUSH_N(int, arena, split_index_count);
-
-    uint32_t count = 0;
-    for (uint32_t face_id = 0; face_id < CUBE_FACES; ++face_id) {
-        uint32_t index_base = face_id * (index_stride * index_stride);
-        int *cur_loc = cube->indices + (face_id * index_count_per_side);
-
-        for (uint32_t col = 0; col < two_cs_m_one; ++col) {
-            for (uint32_t row = 0; row < two_cs_m_one; ++row) {
-
-                int face_square_indices[4] = {
-                    index_base,                    //
-                    index_base + 1,                //
-                    index_base + index_stride + 1, //
-                    index_base + index_stride,     //
-                };
+// Makes the target's storage `width` by `height` if it isn't already
+static int resize_scaled_target(ScaledTarget *scaled, uint32_t width,
+                                uint32_t height) {
+    if (scaled->width == width && scaled->height == height) {
+        return 0;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, scaled->color);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, NULL);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, scaled->depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, scaled->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           scaled->color, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, scaled->depth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        scaled->width = scaled->height = 0;
+        return -1;
+    }
+
+    scaled->width = width;
+    scaled->height = height;
+
+    return 0;
+}
+
+// Time spent drawing grows with the number of pixels, the square of the scale.
+// A scale is only grown once frames would fit GPU_GROW_HEADROOM of the budget,
+// so that one that only just fits isn't left and come back to
+static float choose_render_scale(float scale, double gpu_seconds) {
+    double ratio = GPU_BUDGET_SECONDS / gpu_seconds;
+    int within_budget = ratio >= 1.0;
+    float wanted;
+
+    if (within_budget) {
+        ratio *= GPU_GROW_HEADROOM;
+    }
+
+    // in whole steps, so that timing noise doesn't resize the target
+    wanted = scale * sqrtf((float)ratio);
+    wanted = RENDER_SCALE_STEP * floorf(wanted / RENDER_SCALE_STEP + 1e-3f);
+    if (within_budget && wanted < scale) {
+        wanted = scale;
+    }
+
+    return DANGEROUS_CLAMP(MIN_RENDER_SCALE, wanted, 1.0f);
+}
+
+static int compare_doubles(void const *a, void const *b) {
+    double x = *(double const *)a;
+    double y = *(double const *)b;
+
+    return (x > y) - (x < y);
+}
+
+// Reads back the timer queries the GPU has finished with, oldest first, and
+// picks a new scale every GPU_TIME_SAMPLES of them
+static void read_gpu_times(ScaledTarget *scaled, int dynamic_resolution) {
+    while (scaled->pending > 0) {
+        uint32_t oldest = (scaled->next_query + GPU_TIMER_COUNT -
+                           scaled->pending) % GPU_TIMER_COUNT;
+        GLint available = 0;
+        GLuint64 elapsed_ns;
+
+        glGetQueryObjectiv(scaled->queries[oldest], GL_QUERY_RESULT_AVAILABLE,
+                           &available);
+        if (!available) {
+            break;
+        }
+
+        glGetQueryObjectui64v(scaled->queries[oldest], GL_QUERY_RESULT,
+                              &elapsed_ns);
+        scaled->pending -= 1;
+
+        if (scaled->stale > 0) {
+            scaled->stale -= 1;
+            continue;
+        }
+
+        scaled->gpu_seconds[scaled->samples++] = elapsed_ns / 1e9;
+    }
+
+    if (scaled->samples == GPU_TIME_SAMPLES) {
+        float scale = scaled->scale;
+
+        // the median, as a frame that uploads the whole cube takes far longer
+        // than the rest
+        qsort(scaled->gpu_seconds, GPU_TIME_SAMPLES, sizeof(double),
+              compare_doubles);
+        if (dynamic_resolution) {
+            scale = choose_render_scale(
+                scale, scaled->gpu_seconds[GPU_TIME_SAMPLES / 2]);
+        }
+
+        // frames timed at the old scale don't say anything about the new one
+        if (scale != scaled->scale) {
+            scaled->scale = scale;
+            scaled->stale = scaled->pending;
+        }
+        scaled->samples = 0;
+    }
+}
+
+// Reads the frame just drawn into the capture ring, if it is being recorded or
+// a screenshot was asked for
+static void capture_drawn_frame(Application *app, uint32_t width,
+                                uint32_t height) {
+    Capture *capture = &app->capture;
+
+    if (app->state.screenshot_requested) {
+        char name[64];
+        FILE *file;
+
+        app->state.screenshot_requested = 0;
+        snprintf(name, sizeof(name), SCREENSHOT_NAME_FORMAT, (long)time(NULL),
+                 capture->screenshots++);
 
-                expand_vertices_to_triangles(face_square_indices, 4, 4,
-                                             cur_loc);
-                cur_loc += expanded_square_vertices;
-                count += expanded_square_vertices;
-                index_base += 1;
+        if (init_capture(capture) != 0 || (file = fopen(name, "wb")) == NULL) {
+            fprintf(stderr, "Couldn't save a screenshot to %s\n", name);
+        } else {
+            // a screenshot waits for a slot rather than being dropped
+            if (capture->slots[capture->next_slot].state != CS_Free) {
+                flush_captures(capture);
             }
-            index_base += 1;
+            capture_frame(capture, app->offscreen.framebuffer, width, height,
+                          file, 1);
+            printf("Saving a screenshot to %s\n", name);
+        }
+    }
+
+    if (capture->recording != NULL) {
+        if (capture_frame(capture, app->offscreen.framebuffer, width, height,
+                          capture->recording, 0) == 0) {
+            capture->captured += 1;
+        } else {
+            capture->dropped += 1;
         }
     }
+}
 
-    if (count != split_index_count) {
-        fprintf(stderr, "Wrong index count\n");
+static void render(Application *app) {
+    // TODO: Get the screen width and height and use a "pixels to meters" type
+    // thing like from Handmade Hero?
+
+    ScaledTarget *scaled = &app->scaled;
+    uint32_t window_width = app->state.window_width;
+    uint32_t window_height = app->state.window_height;
+    uint32_t width = window_width;
+    uint32_t height = window_height;
+    GLuint target = app->offscreen.framebuffer;
+    int use_scaled = app->state.dynamic_resolution && scaled->scale < 1.0f;
+    int timed = scaled->pending < GPU_TIMER_COUNT;
+
+    if (use_scaled) {
+        width = DANGEROUS_MAX(1, (uint32_t)(scaled->scale * width));
+        height = DANGEROUS_MAX(1, (uint32_t)(scaled->scale * height));
+
+        if (resize_scaled_target(scaled, width, height) != 0) {
+            fprintf(stderr, "Couldn't make a target to draw at a lower size\n");
+            use_scaled = 0;
+            width = window_width;
+            height = window_height;
+        }
     }
 
-#if 1
-    for (uint32_t i = 0;
-         i < cube->index_count / expanded_square_vertices / CUBE_FACES; ++i) {
-        printf("cube->indices[%03d..%03d] = { ", expanded_square_vertices * i,
-               expanded_square_vertices * (i + 1));
+    // the cube is drawn the same at any size, only with fewer pixels
+    V2 dim_vec = {
+        .x = (float)width,
+        .y = (float)height,
+    };
+
+    glBindFramebuffer(GL_FRAMEBUFFER,
+                      use_scaled ? scaled->framebuffer : target);
+    glViewport(0, 0, width, height);
+
+    if (arena_begin(app->arena) == 0) {
+        int drawn;
+
+        if (timed) {
+            glBeginQuery(GL_TIME_ELAPSED, scaled->queries[scaled->next_query]);
+        }
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // TODO: maybe write some wrappers for this?
+        drawn = render_cube(app, dim_vec) == 0;
+
+        if (drawn && use_scaled) {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, scaled->framebuffer);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+            glBlitFramebuffer(0, 0, width, height, 0, 0, window_width,
+                              window_height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+
+        if (timed) {
+            glEndQuery(GL_TIME_ELAPSED);
+            scaled->next_query = (scaled->next_query + 1) % GPU_TIMER_COUNT;
+            scaled->pending += 1;
+        }
 
-        printf(" %02d", cube->indices[expanded_square_vertices * i]);
-        for (uint32_t j = 1; j < expanded_square_vertices; ++j) {
-            printf(", %02d", cube->indices[expanded_square_vertices * i + j]);
+        if (drawn) {
+            capture_drawn_frame(app, window_width, window_height);
+            if (app->window != NULL) {
+                SDL_GL_SwapWindow(app->window);
+            }
         }
 
-        printf(" }\n");
+        arena_pop(app->arena);
+    }
+
+    read_gpu_times(scaled, app->state.dynamic_resolution);
+    if (app->capture.writer != NULL) {
+        collect_captures(&app->capture, 0);
     }
-#endif
 }
 
-int graphics_main(void) {
+// Everything the cube's colors are drawn from, with the camera far enough back
+// to see the whole scene
+static int init_cube_colors(Application *app, uint32_t cube_count) {
+    uint32_t side_count = get_side_count(app->cube.cube);
+
+    clear_row_ranges(app->cube.texture_dirty, side_count, ALL_FACES);
+    clear_row_ranges(app->cube.colors_dirty, side_count, ALL_FACES);
+    clear_row_ranges(app->cube.summary_dirty, side_count, ALL_FACES);
+
+    if (init_scene(&app->scene, &app->cube, cube_count) != 0 ||
+        init_cube_texture(&app->cube) != 0 ||
+        init_sticker_colors(&app->cube, cube_count) != 0 ||
+        init_cube_summary(&app->cube) != 0) {
+        return -1;
+    }
+
+    app->state.camera.rho = CAMERA_SCREEN_DIST * app->scene.radius;
+
+    return 0;
+}
+
+int graphics_main(uint32_t cube_size, uint32_t cube_count) {
     int ret = 0;
     int sdl_init_ret, gl_init_ret;
-    uint32_t cube_size = 5;
 
     Arena *arena = NULL;
     Cube *cube_state;
     SDL_Window *window = NULL;
     SDL_GLContext *gl_context = NULL;
     GLuint gl_program = 0;
+    GLuint sticker_program = 0;
+    GLuint view_ubo = 0;
+    GLuint palette_ubo = 0;
     GraphicsCube cube = {0};
-    Application app;
+    ScaledTarget scaled = {0};
+    Application app = {0};
 
     arena = alloc_arena();
     if (arena == NULL) {
@@ -1575,7 +2625,9 @@ int graphics_main(void) {
         goto sdl_init_fail;
     }
 
-    if ((gl_init_ret = gl_init(window, &gl_context, &gl_program, &cube)) != 0) {
+    if ((gl_init_ret =
+             gl_init(window, &gl_context, &gl_program, &sticker_program,
+                     &view_ubo, &palette_ubo, &cube, &scaled)) != 0) {
         fprintf(stderr, "Unable to init GLEW and shaders with code %d\n",
                 gl_init_ret);
         goto gl_init_fail;
@@ -1590,31 +2642,47 @@ int graphics_main(void) {
 
     app = (Application){
         .window = window,
-        .last_ticks = SDL_GetTicks(),
+        .last_counter = SDL_GetPerformanceCounter(),
 
         .gl_context = gl_context,
         .gl_program = gl_program,
+        .sticker_program = sticker_program,
+        .view_ubo = view_ubo,
+        .palette_ubo = palette_ubo,
         .cube = cube,
+        .scaled = scaled,
+
+        .solver = NULL,
+        .solution = {0},
 
         .arena = arena,
         .state = get_initial_state(),
     };
 
-    if (arena_begin(arena) == 0) {
-        define_split_vertices(arena, cube_size, &app.cube);
-        define_split_indices(arena, cube_size, &app.cube);
+    init_frame_stats(&app.frame_stats, FRAME_SECONDS);
 
-        while (!app.state.should_close) {
-            StateUpdate s_update;
+    if (init_cube_colors(&app, cube_count) != 0) {
+        fprintf(stderr, "Couldn't allocate space for cube colors\n");
+        app.state.should_close = 1;
+    }
 
-            s_update = get_inputs(&app);
-            update(&app, s_update);
+    while (!app.state.should_close) {
+        StateUpdate s_update;
+
+        s_update = get_inputs(&app);
+        update(&app, s_update);
+
+        // only frames that would look different are drawn
+        if (app.state.needs_redraw) {
             render(&app);
+            app.state.needs_redraw = 0;
         }
-
-        arena_pop(arena);
     }
 
+    // frames still on their way to disk
+    stop_recording(&app.capture);
+    flush_captures(&app.capture);
+
     return ret;
 
 cube_alloc_fail:
@@ -1631,3 +2699,206 @@ arena_alloc_fail:
     app_cleanup(&app);
     return ret;
 }
+
+// The first frame uploads every cube's colors and is the first use of the
+// shaders, so it is reported on its own. The rest are sorted for their
+// percentiles, as batch.c does, so that frames of any length are told apart
+static void write_render_times(FILE *file, double *seconds, uint32_t count) {
+    uint32_t rest = count - 1;
+
+    fprintf(file, "first frame: %.2f ms\n", 1e3 * seconds[0]);
+    if (rest == 0) {
+        return;
+    }
+
+    qsort(seconds + 1, rest, sizeof(double), compare_doubles);
+    fprintf(file,
+            "other %u frames: p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max "
+            "%.2f ms\n",
+            rest, 1e3 * seconds[1 + (rest - 1) * 50 / 100],
+            1e3 * seconds[1 + (rest - 1) * 95 / 100],
+            1e3 * seconds[1 + (rest - 1) * 99 / 100], 1e3 * seconds[count - 1]);
+}
+
+// Frames are timed from the start of drawing until the GPU is done with them,
+// and they are read back when they are to be written
+int render_main(int argc, char **argv) {
+    int ret = 0;
+    int gl_init_ret;
+    uint32_t cube_size, cube_count, frame_count, width, height;
+    float fit;
+    double *frame_seconds;
+    FILE *out = NULL;
+
+    HeadlessContext *headless = NULL;
+    Arena *arena = NULL;
+    Cube *cube_state;
+    SDL_GLContext *gl_context = NULL; // the headless one is already current
+    GLuint gl_program = 0;
+    GLuint sticker_program = 0;
+    GLuint view_ubo = 0;
+    GLuint palette_ubo = 0;
+    GraphicsCube cube = {0};
+    ScaledTarget scaled = {0};
+    Application app = {0};
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+
+    if (argc < 5 || argc > 6 || atoi(argv[0]) < 1 || atoi(argv[1]) < 1 ||
+        atoi(argv[2]) < 1 || atoi(argv[3]) < 1 || atoi(argv[4]) < 1) {
+        fprintf(stderr, "usage: cube render <sides> <cubes> <frames> <width> "
+                        "<height> [out.ppm]\n");
+        return 1;
+    }
+
+    cube_size = atoi(argv[0]);
+    cube_count = atoi(argv[1]);
+    frame_count = atoi(argv[2]);
+    width = atoi(argv[3]);
+    height = atoi(argv[4]);
+
+    frame_seconds = (double *)malloc(frame_count * sizeof(double));
+    if (frame_seconds == NULL) {
+        fprintf(stderr, "Couldn't allocate times for %u frames\n",
+                frame_count);
+        return 1;
+    }
+
+    if (argc > 5 && (out = fopen(argv[5], "wb")) == NULL) {
+        fprintf(stderr, "Couldn't open %s to write frames to\n", argv[5]);
+        free(frame_seconds);
+        return 1;
+    }
+
+    headless = new_headless_context();
+    if (headless == NULL) {
+        fprintf(stderr, "Unable to create a headless OpenGL context\n");
+        goto headless_init_fail;
+    }
+
+    arena = alloc_arena();
+    if (arena == NULL) {
+        fprintf(stderr, "Unable to allocate arena\n");
+        goto arena_alloc_fail;
+    }
+
+    if ((gl_init_ret =
+             gl_init(NULL, &gl_context, &gl_program, &sticker_program,
+                     &view_ubo, &palette_ubo, &cube, &scaled)) != 0) {
+        fprintf(stderr, "Unable to init GLEW and shaders with code %d\n",
+                gl_init_ret);
+        goto gl_init_fail;
+    }
+
+    if ((cube_state = new_cube(cube_size)) == NULL) {
+        fprintf(stderr, "Could not allocate cube\n");
+        goto cube_alloc_fail;
+    }
+
+    cube.cube = cube_state;
+
+    app = (Application){
+        .window = NULL,
+        .last_counter = SDL_GetPerformanceCounter(),
+
+        .gl_context = gl_context,
+        .gl_program = gl_program,
+        .sticker_program = sticker_program,
+        .view_ubo = view_ubo,
+        .palette_ubo = palette_ubo,
+        .cube = cube,
+        .scaled = scaled,
+
+        .solver = NULL,
+        .solution = {0},
+
+        .arena = arena,
+        .state = get_initial_state(),
+    };
+
+    app.state.window_width = width;
+    app.state.window_height = height;
+
+    glGenFramebuffers(1, &app.offscreen.framebuffer);
+    glGenTextures(1, &app.offscreen.color);
+    glGenRenderbuffers(1, &app.offscreen.depth);
+
+    if (init_cube_colors(&app, cube_count) != 0 ||
+        resize_scaled_target(&app.offscreen, width, height) != 0 ||
+        (out != NULL && init_capture(&app.capture) != 0)) {
+        fprintf(stderr, "Couldn't set up to draw %u by %u frames\n", width,
+                height);
+        goto render_init_fail;
+    }
+
+    // looking down on a corner, so that three faces show, from far enough
+    // back that the ball around the scene fits across the shorter side
+    fit = CAMERA_SCREEN_DIST * sqrtf((float)width * width + height * height) /
+          DANGEROUS_MIN(width, height);
+    app.state.camera.rho = app.scene.radius * sqrtf(1.0f + fit * fit);
+    app.state.camera.theta = PI / 4.0;
+    app.state.camera.phi = PI / 3.0;
+
+    for (uint32_t frame = 0; frame < frame_count; ++frame) {
+        Uint64 start = SDL_GetPerformanceCounter();
+
+        turn_scene_cubes(&app.scene, FRAME_SECONDS);
+        update_intersection_info(&app.state, &app.cube, app.scene.radius, 0);
+        app.state.cube_intersection_found = 0;
+
+        render(&app);
+
+        // the read waits for the frame to be drawn, and for a slot once the
+        // writer falls behind
+        if (out != NULL) {
+            if (app.capture.slots[app.capture.next_slot].state != CS_Free) {
+                flush_captures(&app.capture);
+            }
+            capture_frame(&app.capture, app.offscreen.framebuffer, width,
+                          height, out, 0);
+            collect_captures(&app.capture, 1);
+        } else {
+            glFinish();
+        }
+
+        frame_seconds[frame] =
+            (double)(SDL_GetPerformanceCounter() - start) / frequency;
+        app.state.camera.theta += HEADLESS_ORBIT_STEP;
+    }
+
+    flush_captures(&app.capture);
+    write_render_times(stdout, frame_seconds, frame_count);
+
+    app_cleanup(&app);
+    free_cube(cube_state);
+    free_headless_context(headless);
+    free(frame_seconds);
+    if (out != NULL && fclose(out) != 0) {
+        fprintf(stderr, "Couldn't write frames to %s\n", argv[5]);
+        return 1;
+    }
+
+    return ret;
+
+render_init_fail:
+    ret += 1;
+    free_cube(cube_state);
+
+cube_alloc_fail:
+    ret += 1;
+
+gl_init_fail:
+    ret += 1;
+
+arena_alloc_fail:
+    ret += 1;
+    app_cleanup(&app);
+    free_headless_context(headless);
+
+headless_init_fail:
+    ret += 1;
+    free(frame_seconds);
+    if (out != NULL) {
+        fclose(out);
+    }
+    return ret;
+}
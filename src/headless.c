@@ -0,0 +1,133 @@
+#include "headless.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct headless_context {
+    EGLDisplay display;
+    EGLContext context;
+};
+
+static int has_extension(char const *extensions, char const *name) {
+    size_t length = strlen(name);
+    char const *found = extensions;
+
+    while (extensions != NULL && (found = strstr(found, name)) != NULL) {
+        if ((found == extensions || found[-1] == ' ') &&
+            (found[length] == ' ' || found[length] == '\0')) {
+            return 1;
+        }
+        found += length;
+    }
+
+    return 0;
+}
+
+// Mesa's surfaceless platform needs no display server or device node, other
+// drivers are left to pick their own default
+static EGLDisplay get_display(void) {
+    char const *client = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+    if (has_extension(client, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+                "eglGetPlatformDisplayEXT");
+
+        if (get_platform_display != NULL) {
+            return get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                                        EGL_DEFAULT_DISPLAY, NULL);
+        }
+    }
+
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+HeadlessContext *new_headless_context(void) {
+    EGLint const config_attributes[] = {
+        EGL_SURFACE_TYPE, 0,                 // never drawn to
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, //
+        EGL_RED_SIZE, 8,                     //
+        EGL_GREEN_SIZE, 8,                   //
+        EGL_BLUE_SIZE, 8,                    //
+        EGL_DEPTH_SIZE, 24,                  //
+        EGL_NONE,
+    };
+    EGLint const context_attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,        //
+        EGL_CONTEXT_MINOR_VERSION, 2,        //
+        EGL_CONTEXT_OPENGL_PROFILE_MASK,     //
+        EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, //
+        EGL_NONE,
+    };
+    HeadlessContext *headless;
+    EGLConfig config;
+    EGLint major, minor, config_count;
+
+    headless = (HeadlessContext *)calloc(1, sizeof(HeadlessContext));
+    if (headless == NULL) {
+        return NULL;
+    }
+
+    headless->display = get_display();
+    if (headless->display == EGL_NO_DISPLAY ||
+        !eglInitialize(headless->display, &major, &minor)) {
+        fprintf(stderr, "Couldn't open an EGL display\n");
+        free(headless);
+        return NULL;
+    }
+
+    // the context is made current without a surface to draw to
+    if (!has_extension(eglQueryString(headless->display, EGL_EXTENSIONS),
+                       "EGL_KHR_surfaceless_context")) {
+        fprintf(stderr, "EGL %d.%d can't make surfaceless contexts\n", major,
+                minor);
+        goto context_fail;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API) ||
+        !eglChooseConfig(headless->display, config_attributes, &config, 1,
+                         &config_count) ||
+        config_count < 1) {
+        fprintf(stderr, "No EGL config can draw with OpenGL\n");
+        goto context_fail;
+    }
+
+    headless->context = eglCreateContext(headless->display, config,
+                                         EGL_NO_CONTEXT, context_attributes);
+    if (headless->context == EGL_NO_CONTEXT) {
+        fprintf(stderr, "Couldn't create an OpenGL 4.2 context: 0x%x\n",
+                eglGetError());
+        goto context_fail;
+    }
+
+    if (!eglMakeCurrent(headless->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                        headless->context)) {
+        fprintf(stderr, "Couldn't make the OpenGL context current\n");
+        goto current_fail;
+    }
+
+    return headless;
+
+current_fail:
+    eglDestroyContext(headless->display, headless->context);
+
+context_fail:
+    eglTerminate(headless->display);
+    free(headless);
+    return NULL;
+}
+
+void free_headless_context(HeadlessContext *headless) {
+    if (headless == NULL) {
+        return;
+    }
+
+    eglMakeCurrent(headless->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                   EGL_NO_CONTEXT);
+    eglDestroyContext(headless->display, headless->context);
+    eglTerminate(headless->display);
+    free(headless);
+}
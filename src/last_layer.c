@@ -0,0 +1,650 @@
+#include "last_layer.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+#define LL_SIDES 3
+#define LL_PIECES 4
+#define LL_EDGE_BASE (3 * LL_PIECES)
+#define LL_FACELETS (LL_EDGE_BASE + 2 * LL_PIECES)
+
+// The index is (corner perm, edge perm, twist per corner, flip per edge). Only
+// a third of the twists, half of the flips and half of the permutation pairs
+// can be reached, but a sparse table keeps the index a plain mixed radix number
+#define LL_INDEX_COUNT (24 * 24 * 81 * 16)
+#define LL_REACHABLE_COUNT (24 * 24 / 2 * 27 * 8)
+
+#define LL_INVALID 0xFF
+#define LL_UNREACHED 0xFFFFFFFF
+#define LL_MAX_DISTANCE 0xFF
+
+#define LL_MAX_GENERATORS 32
+#define LL_MAX_GENERATOR_MOVES 32
+#define LL_MAX_OLL_CASES 64
+
+typedef struct {
+    uint32_t alg_offset;
+    uint16_t ll_case;
+    uint8_t alg_length;
+    uint8_t oll_case;
+} LLEntry;
+
+struct ll_table {
+    // storage index of each last layer sticker: 4 corners of 3 stickers, then
+    // 4 edges of 2 stickers, with the yellow face sticker first in each piece
+    uint32_t facelets[LL_FACELETS];
+    FaceColor solved[LL_FACELETS];
+
+    uint8_t corner_of_colors[1 << FC_Count];
+    uint8_t edge_of_colors[1 << FC_Count];
+    uint8_t perm_rank[1 << (2 * LL_PIECES)];
+
+    LLEntry *entries;
+    Move *moves;
+
+    uint16_t *case_pll;
+    uint16_t *case_zbll;
+
+    LLCaseCounts counts;
+};
+
+typedef struct {
+    uint8_t perm[LL_FACELETS];
+    Move moves[LL_MAX_GENERATOR_MOVES];
+    uint32_t move_count;
+} Generator;
+
+// every last layer state is reached by some chain of these (and their
+// inverses), and each state keeps the shortest chain by move count
+static char const *generator_algorithms[] = {
+    "U",
+    "R U R' U R U2 R'",                           // Sune
+    "R U R' U R U' R' U R U2 R'",                 // double Sune
+    "F R U R' U' F'",                             //
+    "R U R' U' R' F R F'",                        //
+    "R U' R U R U R U' R' U' R2",                 // Ua
+    "R U R' U' R' F R2 U' R' U' R U R' F'",       // T
+    "F R U' R' U' R U R' F' R U R' U' R' F R F'", // Y
+    "R U R' F' R U R' U' R' F R2 U' R'",          //
+    "R U' L' U R' U' L",                          // Niklas
+    "M2 U M2 U2 M2 U M2",                         // H
+};
+
+static uint32_t const corner_layers[LL_PIECES][2] = {
+    {0, 0}, {0, 2}, {2, 2}, {2, 0}, //
+};
+
+static uint32_t const edge_layers[LL_PIECES][2] = {
+    {0, 1}, {1, 2}, {2, 1}, {1, 0}, //
+};
+
+static inline uint32_t piece_base(uint32_t facelet) {
+    return facelet < LL_EDGE_BASE
+               ? facelet - (facelet % 3)
+               : facelet - ((facelet - LL_EDGE_BASE) % 2);
+}
+
+static inline uint32_t piece_size(uint32_t facelet) {
+    return facelet < LL_EDGE_BASE ? 3 : 2;
+}
+
+static uint32_t add_piece_facelets(uint32_t *facelets, uint32_t r_layer,
+                                   uint32_t b_layer) {
+    uint32_t layers[3] = {LL_SIDES - 1, r_layer, b_layer};
+    FaceColor faces[FC_Count - 1] = {FC_Yellow, FC_Red, FC_Orange, FC_Blue,
+                                     FC_Green};
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < ARR_SIZE(faces); ++i) {
+        uint32_t row, col;
+
+        if (get_sticker_at(LL_SIDES, faces[i], layers, &row, &col) == 0) {
+            facelets[count++] = (faces[i] * LL_SIDES + row) * LL_SIDES + col;
+        }
+    }
+
+    return count;
+}
+
+static uint32_t state_index(LLTable const *table, FaceColor const *colors) {
+    uint32_t corner_code = 0;
+    uint32_t edge_code = 0;
+    uint32_t twists = 0;
+    uint32_t flips = 0;
+    uint32_t corner_rank, edge_rank;
+
+    for (uint32_t k = 0; k < LL_PIECES; ++k) {
+        FaceColor const *c = colors + (3 * k);
+        uint32_t piece =
+            table->corner_of_colors[(1 << c[0]) | (1 << c[1]) | (1 << c[2])];
+
+        if (piece == LL_INVALID) {
+            return LL_UNREACHED;
+        }
+
+        corner_code |= piece << (2 * k);
+        twists = 3 * twists + (c[0] == FC_Yellow   ? 0
+                               : c[1] == FC_Yellow ? 1
+                                                   : 2);
+    }
+
+    for (uint32_t k = 0; k < LL_PIECES; ++k) {
+        FaceColor const *c = colors + LL_EDGE_BASE + (2 * k);
+        uint32_t piece = table->edge_of_colors[(1 << c[0]) | (1 << c[1])];
+
+        if (piece == LL_INVALID) {
+            return LL_UNREACHED;
+        }
+
+        edge_code |= piece << (2 * k);
+        flips = 2 * flips + (c[0] == FC_Yellow ? 0 : 1);
+    }
+
+    corner_rank = table->perm_rank[corner_code];
+    edge_rank = table->perm_rank[edge_code];
+
+    if (corner_rank == LL_INVALID || edge_rank == LL_INVALID) {
+        return LL_UNREACHED;
+    }
+
+    return ((corner_rank * 24 + edge_rank) * 81 + twists) * 16 + flips;
+}
+
+static uint32_t perm_index(LLTable const *table, uint8_t const *perm) {
+    FaceColor colors[LL_FACELETS];
+
+    for (uint32_t i = 0; i < LL_FACELETS; ++i) {
+        colors[i] = table->solved[perm[i]];
+    }
+
+    return state_index(table, colors);
+}
+
+static inline void compose(uint8_t const *first, uint8_t const *second,
+                           uint8_t *res) {
+    for (uint32_t i = 0; i < LL_FACELETS; ++i) {
+        res[i] = first[second[i]];
+    }
+}
+
+static uint32_t yellow_mask(LLTable const *table, uint8_t const *perm) {
+    uint32_t mask = 0;
+
+    for (uint32_t i = 0; i < LL_FACELETS; ++i) {
+        if (table->solved[perm[i]] == FC_Yellow) {
+            mask |= 1 << i;
+        }
+    }
+
+    return mask;
+}
+
+static void init_lookups(LLTable *table) {
+    uint32_t next_rank = 0;
+
+    for (uint32_t k = 0; k < LL_PIECES; ++k) {
+        uint32_t count = add_piece_facelets(table->facelets + (3 * k),
+                                            corner_layers[k][0],
+                                            corner_layers[k][1]);
+        DCHECK(count == 3, "Expected 3 stickers on a corner, got %d\n", count);
+    }
+
+    for (uint32_t k = 0; k < LL_PIECES; ++k) {
+        uint32_t count = add_piece_facelets(
+            table->facelets + LL_EDGE_BASE + (2 * k), edge_layers[k][0],
+            edge_layers[k][1]);
+        DCHECK(count == 2, "Expected 2 stickers on an edge, got %d\n", count);
+    }
+
+    for (uint32_t i = 0; i < LL_FACELETS; ++i) {
+        table->solved[i] = table->facelets[i] / (LL_SIDES * LL_SIDES);
+    }
+
+    memset(table->corner_of_colors, LL_INVALID,
+           sizeof(table->corner_of_colors));
+    memset(table->edge_of_colors, LL_INVALID, sizeof(table->edge_of_colors));
+    memset(table->perm_rank, LL_INVALID, sizeof(table->perm_rank));
+
+    for (uint32_t k = 0; k < LL_PIECES; ++k) {
+        FaceColor const *c = table->solved + (3 * k);
+        FaceColor const *e = table->solved + LL_EDGE_BASE + (2 * k);
+
+        table->corner_of_colors[(1 << c[0]) | (1 << c[1]) | (1 << c[2])] = k;
+        table->edge_of_colors[(1 << e[0]) | (1 << e[1])] = k;
+    }
+
+    for (uint32_t code = 0; code < ARR_SIZE(table->perm_rank); ++code) {
+        uint32_t seen = 0;
+
+        for (uint32_t k = 0; k < LL_PIECES; ++k) {
+            seen |= 1 << ((code >> (2 * k)) & 3);
+        }
+
+        if (seen == (1 << LL_PIECES) - 1) {
+            table->perm_rank[code] = next_rank++;
+        }
+    }
+}
+
+static int read_generator(LLTable const *table, Generator *gen) {
+    uint32_t sides_sq = LL_SIDES * LL_SIDES;
+    FaceColor colors[LL_FACELETS];
+    FaceColor const *squares;
+    int ret = 0;
+
+    Cube *cube = new_cube(LL_SIDES);
+    DCHECK(cube != NULL, "Could not allocate cube for last layer table\n");
+
+    apply_moves(cube, gen->moves, gen->move_count);
+    squares = get_squares(cube);
+
+    // the first two layers and the centers have to come back untouched
+    for (uint32_t i = 0; i < FC_Count * sides_sq; ++i) {
+        FaceColor face = i / sides_sq;
+        uint32_t layers[3];
+
+        get_sticker_layers(LL_SIDES, face, (i % sides_sq) / LL_SIDES,
+                           i % LL_SIDES, layers);
+
+        if ((layers[0] != LL_SIDES - 1 || i % sides_sq == sides_sq / 2) &&
+            squares[i] != face) {
+            ret = -1;
+        }
+    }
+
+    for (uint32_t i = 0; i < LL_FACELETS; ++i) {
+        colors[i] = squares[table->facelets[i]];
+    }
+
+    for (uint32_t i = 0; i < LL_FACELETS && ret == 0; ++i) {
+        uint32_t base = piece_base(i);
+        uint32_t size = piece_size(i);
+        uint32_t mask = 0;
+        uint32_t piece, from_base;
+
+        for (uint32_t j = 0; j < size; ++j) {
+            mask |= 1 << colors[base + j];
+        }
+
+        piece = size == 3 ? table->corner_of_colors[mask]
+                          : table->edge_of_colors[mask];
+        if (piece == LL_INVALID) {
+            ret = -1;
+            break;
+        }
+
+        from_base = size == 3 ? 3 * piece : LL_EDGE_BASE + 2 * piece;
+        gen->perm[i] = LL_INVALID;
+        for (uint32_t j = 0; j < size; ++j) {
+            if (table->solved[from_base + j] == colors[i]) {
+                gen->perm[i] = from_base + j;
+            }
+        }
+    }
+
+    free_cube(cube);
+    return ret;
+}
+
+static uint32_t load_generators(LLTable const *table, Generator *gens) {
+    uint32_t gen_count = 0;
+
+    for (uint32_t a = 0; a < ARR_SIZE(generator_algorithms); ++a) {
+        Generator *gen = gens + gen_count;
+        Generator *inverse = gens + gen_count + 1;
+        int parsed;
+
+        DCHECK(gen_count + 2 <= LL_MAX_GENERATORS,
+               "Too many last layer generators\n");
+
+        parsed = parse_moves(generator_algorithms[a], LL_SIDES, gen->moves,
+                             LL_MAX_GENERATOR_MOVES, &gen->move_count);
+        DCHECK(parsed == 0, "Could not parse last layer algorithm %s\n",
+               generator_algorithms[a]);
+
+        inverse->move_count = gen->move_count;
+        for (uint32_t m = 0; m < gen->move_count; ++m) {
+            inverse->moves[m] =
+                invert_move(gen->moves[gen->move_count - 1 - m]);
+        }
+
+        DCHECK(read_generator(table, gen) == 0 &&
+                   read_generator(table, inverse) == 0,
+               "Last layer algorithm %s disturbs the first two layers\n",
+               generator_algorithms[a]);
+
+        gen_count += 2;
+    }
+
+    return gen_count;
+}
+
+typedef struct {
+    uint8_t (*perms)[LL_FACELETS];
+    uint32_t *index_of;
+    uint32_t *dense_of;
+    uint32_t *parent;
+    uint32_t *order;
+    uint16_t *dist;
+    uint8_t *via;
+    uint8_t *settled;
+    uint32_t count;
+} Search;
+
+static void search_shortest_chains(LLTable const *table, Search *search,
+                                   Generator const *gens, uint32_t gen_count) {
+    uint32_t settled_count = 0;
+
+    // solved state
+    for (uint32_t i = 0; i < LL_FACELETS; ++i) {
+        search->perms[0][i] = i;
+    }
+    search->index_of[0] = perm_index(table, search->perms[0]);
+    search->dense_of[search->index_of[0]] = 0;
+    search->dist[0] = 0;
+    search->parent[0] = 0;
+    search->count = 1;
+
+    // Dijkstra with unit buckets; distances are small so each bucket is just a
+    // scan over the states found so far
+    for (uint32_t d = 0; settled_count < search->count; ++d) {
+        DCHECK(d <= LL_MAX_DISTANCE, "Last layer chain grew too long\n");
+
+        for (uint32_t s = 0; s < search->count; ++s) {
+            if (search->settled[s] || search->dist[s] != d) {
+                continue;
+            }
+
+            search->settled[s] = 1;
+            search->order[settled_count++] = s;
+
+            for (uint32_t g = 0; g < gen_count; ++g) {
+                uint8_t next[LL_FACELETS];
+                uint32_t next_dist = d + gens[g].move_count;
+                uint32_t index, t;
+
+                compose(search->perms[s], gens[g].perm, next);
+                index = perm_index(table, next);
+                DCHECK(index != LL_UNREACHED,
+                       "Generator left the last layer\n");
+
+                t = search->dense_of[index];
+                if (t == LL_UNREACHED) {
+                    DCHECK(search->count < LL_REACHABLE_COUNT,
+                           "More last layer states than expected\n");
+
+                    t = search->count++;
+                    memcpy(search->perms[t], next, LL_FACELETS);
+                    search->index_of[t] = index;
+                    search->dense_of[index] = t;
+                } else if (search->settled[t] ||
+                           search->dist[t] <= next_dist) {
+                    continue;
+                }
+
+                search->dist[t] = next_dist;
+                search->parent[t] = s;
+                search->via[t] = g;
+            }
+        }
+    }
+
+    DCHECK(search->count == LL_REACHABLE_COUNT,
+           "Expected %d last layer states, found %d\n", LL_REACHABLE_COUNT,
+           search->count);
+}
+
+static void store_algorithms(LLTable *table, Search const *search,
+                             Generator const *gens) {
+    uint32_t total = 0;
+    uint32_t cursor = 0;
+
+    for (uint32_t s = 0; s < search->count; ++s) {
+        total += search->dist[s];
+    }
+
+    table->moves = (Move *)malloc(total * sizeof(Move));
+    DCHECK(total == 0 || table->moves != NULL,
+           "Could not allocate last layer algorithms\n");
+
+    // a state is solved by undoing the generator that reached it and then
+    // solving its parent, which was stored earlier in settle order
+    for (uint32_t o = 0; o < search->count; ++o) {
+        uint32_t s = search->order[o];
+        LLEntry *entry = table->entries + search->index_of[s];
+
+        entry->alg_offset = cursor;
+        entry->alg_length = 0;
+
+        if (s != 0) {
+            Generator const *gen = gens + search->via[s];
+            LLEntry const *parent =
+                table->entries + search->index_of[search->parent[s]];
+            Move *alg = table->moves + cursor;
+            uint32_t length = 0;
+
+            for (uint32_t m = 0; m < gen->move_count + parent->alg_length;
+                 ++m) {
+                Move move =
+                    m < gen->move_count
+                        ? invert_move(gen->moves[gen->move_count - 1 - m])
+                        : table->moves[parent->alg_offset + m -
+                                       gen->move_count];
+                Move *last = length > 0 ? alg + (length - 1) : NULL;
+
+                // merge turns of the same layer where the two chains meet
+                if (last != NULL && last->face == move.face &&
+                    last->depth == move.depth) {
+                    last->turns = (last->turns + move.turns) % 4;
+                    length -= last->turns == 0;
+                } else {
+                    alg[length++] = move;
+                }
+            }
+
+            entry->alg_length = length;
+            cursor += length;
+        }
+    }
+
+    table->counts.stored_moves = cursor;
+}
+
+static void classify_cases(LLTable *table, Search const *search,
+                           Generator const *u_turn) {
+    uint32_t oriented = 0;
+    uint32_t edges_oriented = 0;
+    uint32_t oll_masks[LL_MAX_OLL_CASES];
+    uint8_t u_pow[4][LL_FACELETS];
+
+    for (uint32_t k = 0; k < LL_PIECES; ++k) {
+        oriented |= 1 << (3 * k);
+        edges_oriented |= 1 << (LL_EDGE_BASE + 2 * k);
+    }
+    oriented |= edges_oriented;
+
+    for (uint32_t i = 0; i < LL_FACELETS; ++i) {
+        u_pow[0][i] = i;
+    }
+    for (uint32_t p = 1; p < 4; ++p) {
+        compose(u_pow[p - 1], u_turn->perm, u_pow[p]);
+    }
+
+    for (uint32_t s = 0; s < search->count; ++s) {
+        LLEntry *entry = table->entries + search->index_of[s];
+        uint32_t mask = LL_UNREACHED;
+        uint32_t ll_case;
+
+        // orientation patterns are counted up to turning the whole layer
+        for (uint32_t p = 0; p < 4; ++p) {
+            uint8_t turned[LL_FACELETS];
+            uint32_t turned_mask;
+
+            compose(search->perms[s], u_pow[p], turned);
+            turned_mask = yellow_mask(table, turned);
+            mask = turned_mask < mask ? turned_mask : mask;
+        }
+
+        entry->oll_case = LL_INVALID;
+        for (uint32_t o = 0; o < table->counts.oll_cases; ++o) {
+            if (oll_masks[o] == mask) {
+                entry->oll_case = o;
+            }
+        }
+        if (entry->oll_case == LL_INVALID) {
+            DCHECK(table->counts.oll_cases < LL_MAX_OLL_CASES,
+                   "More orientation cases than expected\n");
+            oll_masks[table->counts.oll_cases] = mask;
+            entry->oll_case = table->counts.oll_cases++;
+        }
+
+        if (entry->ll_case != LL_NO_CASE) {
+            continue;
+        }
+
+        ll_case = table->counts.ll_cases++;
+        for (uint32_t pre = 0; pre < 4; ++pre) {
+            for (uint32_t post = 0; post < 4; ++post) {
+                uint8_t before[LL_FACELETS];
+                uint8_t variant[LL_FACELETS];
+
+                compose(u_pow[pre], search->perms[s], before);
+                compose(before, u_pow[post], variant);
+                table->entries[perm_index(table, variant)].ll_case = ll_case;
+            }
+        }
+
+        mask = yellow_mask(table, search->perms[s]);
+        if ((mask & oriented) == oriented) {
+            table->case_pll[ll_case] = table->counts.pll_cases++;
+        }
+        if ((mask & edges_oriented) == edges_oriented) {
+            table->case_zbll[ll_case] = table->counts.zbll_cases++;
+        }
+    }
+}
+
+LLTable *new_ll_table(void) {
+    Generator gens[LL_MAX_GENERATORS];
+    uint32_t gen_count;
+    Search search;
+
+    LLTable *table = (LLTable *)calloc(1, sizeof(LLTable));
+    if (table == NULL) {
+        return NULL;
+    }
+
+    init_lookups(table);
+    gen_count = load_generators(table, gens);
+
+    table->entries = (LLEntry *)malloc(LL_INDEX_COUNT * sizeof(LLEntry));
+    table->case_pll = (uint16_t *)malloc(LL_REACHABLE_COUNT * sizeof(uint16_t));
+    table->case_zbll =
+        (uint16_t *)malloc(LL_REACHABLE_COUNT * sizeof(uint16_t));
+
+    search = (Search){
+        .perms = malloc(LL_REACHABLE_COUNT * sizeof(*search.perms)),
+        .index_of = (uint32_t *)malloc(LL_REACHABLE_COUNT * sizeof(uint32_t)),
+        .dense_of = (uint32_t *)malloc(LL_INDEX_COUNT * sizeof(uint32_t)),
+        .parent = (uint32_t *)malloc(LL_REACHABLE_COUNT * sizeof(uint32_t)),
+        .order = (uint32_t *)malloc(LL_REACHABLE_COUNT * sizeof(uint32_t)),
+        .dist = (uint16_t *)malloc(LL_REACHABLE_COUNT * sizeof(uint16_t)),
+        .via = (uint8_t *)malloc(LL_REACHABLE_COUNT * sizeof(uint8_t)),
+        .settled = (uint8_t *)calloc(LL_REACHABLE_COUNT, sizeof(uint8_t)),
+        .count = 0,
+    };
+
+    DCHECK(table->entries != NULL && table->case_pll != NULL &&
+               table->case_zbll != NULL && search.perms != NULL &&
+               search.index_of != NULL && search.dense_of != NULL &&
+               search.parent != NULL && search.order != NULL &&
+               search.dist != NULL && search.via != NULL &&
+               search.settled != NULL,
+           "Could not allocate last layer table\n");
+
+    for (uint32_t i = 0; i < LL_INDEX_COUNT; ++i) {
+        table->entries[i] = (LLEntry){
+            .alg_offset = LL_UNREACHED,
+            .ll_case = LL_NO_CASE,
+            .alg_length = 0,
+            .oll_case = LL_INVALID,
+        };
+        search.dense_of[i] = LL_UNREACHED;
+    }
+    for (uint32_t i = 0; i < LL_REACHABLE_COUNT; ++i) {
+        table->case_pll[i] = LL_NO_CASE;
+        table->case_zbll[i] = LL_NO_CASE;
+    }
+
+    search_shortest_chains(table, &search, gens, gen_count);
+    store_algorithms(table, &search, gens);
+    classify_cases(table, &search, &gens[0]);
+
+    table->counts.states = search.count;
+
+    free(search.perms);
+    free(search.index_of);
+    free(search.dense_of);
+    free(search.parent);
+    free(search.order);
+    free(search.dist);
+    free(search.via);
+    free(search.settled);
+
+    return table;
+}
+
+void free_ll_table(LLTable *table) {
+    if (table == NULL)
+        return;
+
+    free(table->entries);
+    free(table->moves);
+    free(table->case_pll);
+    free(table->case_zbll);
+    free(table);
+}
+
+LLCaseCounts ll_case_counts(LLTable const *table) { return table->counts; }
+
+int ll_classify(LLTable const *table, Cube *cube, LLClass *p_class) {
+    FaceColor colors[LL_FACELETS];
+    FaceColor const *squares;
+    LLEntry const *entry;
+    uint32_t index;
+
+    if (get_side_count(cube) != LL_SIDES) {
+        return -1;
+    }
+
+    squares = get_squares(cube);
+    for (uint32_t i = 0; i < LL_FACELETS; ++i) {
+        colors[i] = squares[table->facelets[i]];
+    }
+
+    index = state_index(table, colors);
+    if (index == LL_UNREACHED) {
+        return -1;
+    }
+
+    entry = table->entries + index;
+    if (entry->alg_offset == LL_UNREACHED) {
+        return -1;
+    }
+
+    *p_class = (LLClass){
+        .state = index,
+        .ll_case = entry->ll_case,
+        .oll_case = entry->oll_case,
+        .pll_case = table->case_pll[entry->ll_case],
+        .zbll_case = table->case_zbll[entry->ll_case],
+        .algorithm = table->moves + entry->alg_offset,
+        .algorithm_length = entry->alg_length,
+    };
+
+    return 0;
+}
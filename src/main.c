@@ -1,10 +1,39 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "batch.h"
 #include "graphics.h"
 #include "tests.h"
 
-int main(void) {
+#define DEFAULT_CUBE_SIZE 5
+
+int main(int argc, char **argv) {
+    uint32_t cube_size = DEFAULT_CUBE_SIZE;
+    uint32_t cube_count = 1;
+
+    if (argc > 1 && strcmp(argv[1], "batch") == 0) {
+        return batch_main(argc - 2, argv + 2);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "render") == 0) {
+        return render_main(argc - 2, argv + 2);
+    }
+
+    // `cube [sides [cubes]]` opens the viewer
+    if (argc > 1) {
+        cube_size = (uint32_t)strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        cube_count = (uint32_t)strtoul(argv[2], NULL, 10);
+    }
+    if (cube_size == 0 || cube_count == 0) {
+        fprintf(stderr, "usage: cube [sides [cubes]] | cube batch ... | "
+                        "cube render ...\n");
+        return 1;
+    }
+
     // swap out which test to run for now
     // TODO: build a better testing "framework"
-    return graphics_main();
+    return graphics_main(cube_size, cube_count);
 }
@@ -28,6 +28,16 @@ int const face_indices[CUBE_FACES * SQUARE_CORNERS] = {
     5, 6, 7, 4, // yellow
 };
 
+// the outward normal of each face, in the order of face_indices
+V3 const face_normals[CUBE_FACES] = {
+    {.x = (+0.0f), .y = (+0.0f), .z = (+1.0f)}, // white
+    {.x = (+1.0f), .y = (+0.0f), .z = (+0.0f)}, // red
+    {.x = (+0.0f), .y = (+1.0f), .z = (+0.0f)}, // blue
+    {.x = (-1.0f), .y = (+0.0f), .z = (+0.0f)}, // orange
+    {.x = (+0.0f), .y = (-1.0f), .z = (+0.0f)}, // green
+    {.x = (+0.0f), .y = (+0.0f), .z = (-1.0f)}, // yellow
+};
+
 int const cube_vert_count = ARR_SIZE(cube_vertices);
 int const face_index_count = ARR_SIZE(face_indices);
 
@@ -67,33 +77,19 @@ FaceColor get_cube_face(V3 point) {
     }
 }
 
-void expand_vertices_to_triangles(int const *indices, uint32_t index_count,
-                                  uint32_t indices_per_face, int *triangles) {
-    uint32_t face_count = index_count / indices_per_face;
-    uint32_t triangle_indices_per_face =
-        VERTEX_COUNT_TO_TRIANGLE_COUNT(indices_per_face);
-
-    uint32_t triangles_per_face = triangle_indices_per_face / 3;
-
-    for (uint32_t face_id = 0; face_id < face_count; ++face_id) {
-        int f_base = face_id * indices_per_face;
-        int tf_base = face_id * triangle_indices_per_face;
-        int last_end = 2;
+// The camera sits at the origin, so a face is seen from the front when the
+// camera is on the outside of its plane, that is when the face's center
+// `cube_center + n` points against its normal `n`
+uint32_t get_visible_faces(V3 cube_center) {
+    uint32_t visible = 0;
 
-        triangles[tf_base + 0] = indices[f_base + 0];
-        triangles[tf_base + 1] = indices[f_base + 1];
-        triangles[tf_base + 2] = indices[f_base + 2];
-
-        for (int i = 1; i < triangles_per_face; ++i) {
-            int offset = 3 * i;
-
-            triangles[tf_base + offset + 0] = indices[f_base + 0];
-            triangles[tf_base + offset + 1] = indices[f_base + last_end + 0];
-            triangles[tf_base + offset + 2] = indices[f_base + last_end + 1];
-
-            last_end = last_end + 1;
+    for (int face = 0; face < CUBE_FACES; ++face) {
+        if (dot(face_normals[face], cube_center) < -1.0f) {
+            visible |= 1u << face;
         }
     }
+
+    return visible;
 }
 
 inline V3 add3(V3 lhs, V3 rhs) {
@@ -183,14 +179,6 @@ V3 decompose(V3 target, V3 dir, V3 *perp) {
     return res;
 }
 
-V3 complete_decomp(V3 target, V3 x, V3 y, V3 z) {
-    return (V3){
-        .x = dot(target, x),
-        .y = dot(target, y),
-        .z = dot(target, z),
-    };
-}
-
 V3 compose(V3 target, V3 x_dir, V3 y_dir, V3 z_dir) {
     V3 x_comp = scale3(x_dir, target.x);
     V3 y_comp = scale3(y_dir, target.y);
@@ -198,3 +186,130 @@ V3 compose(V3 target, V3 x_dir, V3 y_dir, V3 z_dir) {
 
     return add3(add3(x_comp, y_comp), z_comp);
 }
+
+M4 identity4(void) {
+    M4 res = {0};
+
+    for (int i = 0; i < 4; ++i) {
+        res.m[i][i] = 1.0f;
+    }
+
+    return res;
+}
+
+M4 mul4(M4 lhs, M4 rhs) {
+    M4 res;
+
+    for (int col = 0; col < 4; ++col) {
+        for (int row = 0; row < 4; ++row) {
+            float sum = 0.0f;
+
+            for (int k = 0; k < 4; ++k) {
+                sum += lhs.m[k][row] * rhs.m[col][k];
+            }
+            res.m[col][row] = sum;
+        }
+    }
+
+    return res;
+}
+
+// Gauss-Jordan elimination with partial pivoting, on rows of [m | I]
+M4 invert4(M4 m) {
+    float a[4][8];
+    M4 res;
+
+    for (int row = 0; row < 4; ++row) {
+        for (int col = 0; col < 4; ++col) {
+            a[row][col] = m.m[col][row];
+            a[row][col + 4] = row == col ? 1.0f : 0.0f;
+        }
+    }
+
+    for (int col = 0; col < 4; ++col) {
+        int pivot = col;
+        float inv;
+
+        for (int row = col + 1; row < 4; ++row) {
+            if (fabsf(a[row][col]) > fabsf(a[pivot][col])) {
+                pivot = row;
+            }
+        }
+        if (a[pivot][col] == 0.0f) {
+            return (M4){0};
+        }
+
+        if (pivot != col) {
+            for (int k = 0; k < 8; ++k) {
+                float tmp = a[col][k];
+                a[col][k] = a[pivot][k];
+                a[pivot][k] = tmp;
+            }
+        }
+
+        inv = 1.0f / a[col][col];
+        for (int k = 0; k < 8; ++k) {
+            a[col][k] *= inv;
+        }
+
+        for (int row = 0; row < 4; ++row) {
+            float factor = a[row][col];
+
+            if (row == col || factor == 0.0f) {
+                continue;
+            }
+            for (int k = 0; k < 8; ++k) {
+                a[row][k] -= factor * a[col][k];
+            }
+        }
+    }
+
+    for (int row = 0; row < 4; ++row) {
+        for (int col = 0; col < 4; ++col) {
+            res.m[col][row] = a[row][col + 4];
+        }
+    }
+
+    return res;
+}
+
+V3 transform_point(M4 m, V3 p) {
+    float out[4];
+
+    for (int row = 0; row < 4; ++row) {
+        out[row] = m.m[0][row] * p.x + m.m[1][row] * p.y + m.m[2][row] * p.z +
+                   m.m[3][row];
+    }
+
+    return V3_of(out[0] / out[3], out[1] / out[3], out[2] / out[3]);
+}
+
+M4 look_at(V3 eye, V3 target, V3 up) {
+    V3 forward = as_unit(add3(target, scale3(eye, -1.0f)));
+    V3 side = as_unit(cross(forward, up));
+    V3 true_up = cross(side, forward);
+    M4 res = identity4();
+
+    for (int i = 0; i < 3; ++i) {
+        res.m[i][0] = side.xyz[i];
+        res.m[i][1] = true_up.xyz[i];
+        res.m[i][2] = -forward.xyz[i];
+    }
+    res.m[3][0] = -dot(side, eye);
+    res.m[3][1] = -dot(true_up, eye);
+    res.m[3][2] = dot(forward, eye);
+
+    return res;
+}
+
+M4 perspective(float focal, float aspect, float near_z, float far_z) {
+    M4 res = {0};
+
+    res.m[0][0] = focal / aspect;
+    res.m[1][1] = focal;
+    res.m[2][2] = (far_z + near_z) / (near_z - far_z);
+    res.m[2][3] = -1.0f;
+    res.m[3][2] = 2.0f * far_z * near_z / (near_z - far_z);
+
+    return res;
+}
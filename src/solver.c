@@ -0,0 +1,1268 @@
+#include "solver.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+
+#define MAX_ORBIT_SLOTS 24
+#define MAX_SLOT_STICKERS 3
+#define MAX_CYCLE_STICKERS (3 * MAX_SLOT_STICKERS)
+#define MAX_ORBIT_STICKERS (2 * MAX_ORBIT_SLOTS)
+#define MAX_TEMPLATE_MOVES 8
+#define MAX_TEMPLATES 1728
+#define SETUP_COUNT (3 * FC_Count)
+#define MAX_CENTER_MOVES 3
+#define MAX_KICKS 64
+#define MAX_TURN_DEPTHS 4
+// cycles looked at per step of the search for pairs of cycles
+#define PAIR_EVALS (1 << 16)
+#define ROTATION_COUNT 24
+
+#define INITIAL_MOVE_CAPACITY 1024
+
+typedef struct {
+    int32_t x, y, z;
+} IV3;
+
+// positions are cubie centers in doubled coordinates, so each component is an
+// odd or even integer in [-(sides - 1), sides - 1]
+typedef struct {
+    IV3 pos;
+    IV3 normal;
+} Sticker;
+
+typedef struct {
+    int32_t m[3][3];
+} Rotation;
+
+typedef struct {
+    IV3 pos;
+    uint32_t stickers[MAX_SLOT_STICKERS];
+    Sticker sticker[MAX_SLOT_STICKERS];
+    uint32_t sticker_count;
+} Slot;
+
+// every position a piece can be moved to, one slot per piece
+typedef struct {
+    Slot slots[MAX_ORBIT_SLOTS];
+    uint32_t slot_count;
+
+    // the stickers of all slots in slot order; commutators refer to stickers
+    // by their number in this list
+    uint32_t stickers[MAX_ORBIT_STICKERS];
+    FaceColor faces[MAX_ORBIT_STICKERS];
+    uint32_t sticker_count;
+
+    // setups[s][i] is the sticker that undoing setup turn s takes sticker i
+    // to. Row 0 is the identity and the face turns are only filled in once the
+    // plain commutators stop helping
+    uint8_t setups[SETUP_COUNT + 1][MAX_ORBIT_STICKERS];
+    uint32_t setup_count;
+} Orbit;
+
+// a commutator together with the orbit stickers it cycles
+typedef struct {
+    Move moves[MAX_TEMPLATE_MOVES];
+    uint32_t move_count;
+    uint8_t from[MAX_CYCLE_STICKERS];
+    uint8_t to[MAX_CYCLE_STICKERS];
+    uint32_t sticker_count;
+} Template;
+
+// a template conjugated by one of the orbit's setups
+typedef struct {
+    Template const *t;
+    uint32_t setup;
+} Cycle;
+
+struct solver {
+    uint32_t sides;
+    Cube *work;
+    Rotation rotations[ROTATION_COUNT];
+
+    Template *templates;
+    uint32_t template_count;
+
+    // the number of each sticker in the current orbit
+    uint8_t *orbit_numbers;
+
+    // where each sticker of the current orbit goes under a single turn,
+    // filled in the first time a template needs that turn
+    uint16_t turn_depths[MAX_TURN_DEPTHS];
+    uint32_t turn_depth_count;
+    uint8_t turn_ready[MAX_TURN_DEPTHS][FC_Count][3];
+    uint8_t turns[MAX_TURN_DEPTHS][FC_Count][3][MAX_ORBIT_STICKERS];
+
+    // marks white face stickers whose center orbit has been solved
+    uint8_t *seen;
+
+    uint32_t kick_state;
+
+    // moves are only merged within a phase so the per phase counts add up
+    uint32_t phase_start;
+
+    // where an incremental solve is up to: the phase, the next orbit to set
+    // up within it and the orbit being solved, if any
+    SolvePhase phase;
+    uint32_t cursor;
+    int orbit_active;
+    Orbit orbit;
+    uint32_t base_count;
+    uint32_t kicks;
+    int pair_search;
+    uint32_t pair_next;
+    uint32_t stickers_done;
+};
+
+static IV3 const face_normals[FC_Count] = {
+    [FC_White] = {0, 0, 1},   [FC_Red] = {1, 0, 0},
+    [FC_Blue] = {0, 1, 0},    [FC_Orange] = {-1, 0, 0},
+    [FC_Green] = {0, -1, 0},  [FC_Yellow] = {0, 0, -1},
+};
+
+// the face each layer coordinate is counted from
+static FaceColor const axis_faces[3] = {FC_White, FC_Red, FC_Blue};
+
+static inline uint32_t face_axis(FaceColor face) {
+    switch (face) {
+    case FC_White:
+    case FC_Yellow:
+        return 0;
+    case FC_Red:
+    case FC_Orange:
+        return 1;
+    default:
+        return 2;
+    }
+}
+
+static inline int32_t dot_i(IV3 lhs, IV3 rhs) {
+    return lhs.x * rhs.x + lhs.y * rhs.y + lhs.z * rhs.z;
+}
+
+static inline IV3 cross_i(IV3 lhs, IV3 rhs) {
+    return (IV3){
+        lhs.y * rhs.z - lhs.z * rhs.y,
+        lhs.z * rhs.x - lhs.x * rhs.z,
+        lhs.x * rhs.y - lhs.y * rhs.x,
+    };
+}
+
+static inline int equal_i(IV3 lhs, IV3 rhs) {
+    return lhs.x == rhs.x && lhs.y == rhs.y && lhs.z == rhs.z;
+}
+
+static inline IV3 rotate_i(Rotation const *rot, IV3 v) {
+    return (IV3){
+        rot->m[0][0] * v.x + rot->m[0][1] * v.y + rot->m[0][2] * v.z,
+        rot->m[1][0] * v.x + rot->m[1][1] * v.y + rot->m[1][2] * v.z,
+        rot->m[2][0] * v.x + rot->m[2][1] * v.y + rot->m[2][2] * v.z,
+    };
+}
+
+// the layer `pos` sits in along `axis`, counted from axis_faces[axis]
+static inline uint32_t pos_layer(uint32_t sides, IV3 pos, uint32_t axis) {
+    int32_t coord = axis == 0 ? pos.z : axis == 1 ? pos.x : pos.y;
+
+    return ((int32_t)sides - 1 - coord) / 2;
+}
+
+static FaceColor face_of_normal(IV3 normal) {
+    for (uint32_t face = 0; face < FC_Count; ++face) {
+        if (equal_i(face_normals[face], normal)) {
+            return face;
+        }
+    }
+
+    DCHECK(0, "(%d, %d, %d) is not a face normal\n", normal.x, normal.y,
+           normal.z);
+    return FC_Count;
+}
+
+static Sticker sticker_of(uint32_t sides, uint32_t index) {
+    FaceColor face = index / (sides * sides);
+    int32_t max = sides - 1;
+    uint32_t layers[3];
+
+    get_sticker_layers(sides, face, index / sides % sides, index % sides,
+                       layers);
+
+    return (Sticker){
+        .pos = {max - 2 * (int32_t)layers[1], max - 2 * (int32_t)layers[2],
+                max - 2 * (int32_t)layers[0]},
+        .normal = face_normals[face],
+    };
+}
+
+static uint32_t index_of(uint32_t sides, Sticker sticker) {
+    FaceColor face = face_of_normal(sticker.normal);
+    uint32_t layers[3];
+    uint32_t row, col;
+    int ret;
+
+    for (uint32_t axis = 0; axis < 3; ++axis) {
+        layers[axis] = pos_layer(sides, sticker.pos, axis);
+    }
+
+    ret = get_sticker_at(sides, face, layers, &row, &col);
+    DCHECK(ret == 0, "Sticker is not on face %d\n", face);
+
+    return (face * sides + row) * sides + col;
+}
+
+// a clockwise quarter turn seen from outside the face with normal `n`
+static inline IV3 turn_vector(IV3 n, IV3 v) {
+    int32_t along = dot_i(n, v);
+    IV3 c = cross_i(n, v);
+
+    return (IV3){n.x * along - c.x, n.y * along - c.y, n.z * along - c.z};
+}
+
+static Sticker move_sticker(uint32_t sides, Sticker sticker, Move move) {
+    IV3 n = face_normals[move.face];
+
+    if (dot_i(n, sticker.pos) != (int32_t)sides - 1 - 2 * (int32_t)move.depth) {
+        return sticker;
+    }
+
+    for (uint32_t i = 0; i < move.turns; ++i) {
+        sticker.pos = turn_vector(n, sticker.pos);
+        sticker.normal = turn_vector(n, sticker.normal);
+    }
+
+    return sticker;
+}
+
+static Sticker trace_sticker(uint32_t sides, Sticker sticker,
+                             Move const *moves, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+        sticker = move_sticker(sides, sticker, moves[i]);
+    }
+
+    return sticker;
+}
+
+static void init_rotations(Rotation *rotations) {
+    static uint32_t const perms[6][3] = {
+        {0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0},
+    };
+    uint32_t count = 0;
+
+    for (uint32_t p = 0; p < 6; ++p) {
+        for (uint32_t signs = 0; signs < 8; ++signs) {
+            Rotation rot = {0};
+            int32_t det;
+
+            for (uint32_t row = 0; row < 3; ++row) {
+                rot.m[row][perms[p][row]] = (signs >> row) & 1 ? -1 : 1;
+            }
+
+            det = rot.m[0][0] * (rot.m[1][1] * rot.m[2][2] -
+                                 rot.m[1][2] * rot.m[2][1]) -
+                  rot.m[0][1] * (rot.m[1][0] * rot.m[2][2] -
+                                 rot.m[1][2] * rot.m[2][0]) +
+                  rot.m[0][2] * (rot.m[1][0] * rot.m[2][1] -
+                                 rot.m[1][1] * rot.m[2][0]);
+            if (det == 1) {
+                rotations[count++] = rot;
+            }
+        }
+    }
+
+    DCHECK(count == ROTATION_COUNT, "Found %d cube rotations\n", count);
+}
+
+static void build_orbit(Solver *solver, uint32_t const *seed,
+                        uint32_t seed_count, Orbit *orbit) {
+    Sticker seed_stickers[MAX_SLOT_STICKERS];
+
+    for (uint32_t i = 0; i < seed_count; ++i) {
+        seed_stickers[i] = sticker_of(solver->sides, seed[i]);
+    }
+
+    orbit->slot_count = 0;
+    for (uint32_t r = 0; r < ROTATION_COUNT; ++r) {
+        Rotation const *rot = solver->rotations + r;
+        IV3 pos = rotate_i(rot, seed_stickers[0].pos);
+        Slot *slot;
+        int known = 0;
+
+        for (uint32_t s = 0; s < orbit->slot_count && !known; ++s) {
+            known = equal_i(orbit->slots[s].pos, pos);
+        }
+        if (known) {
+            continue;
+        }
+
+        DCHECK(orbit->slot_count < MAX_ORBIT_SLOTS, "Orbit is too large\n");
+        slot = orbit->slots + orbit->slot_count++;
+        slot->pos = pos;
+        slot->sticker_count = seed_count;
+        for (uint32_t i = 0; i < seed_count; ++i) {
+            slot->sticker[i] = (Sticker){
+                .pos = pos,
+                .normal = rotate_i(rot, seed_stickers[i].normal),
+            };
+            slot->stickers[i] = index_of(solver->sides, slot->sticker[i]);
+        }
+    }
+
+    orbit->sticker_count = 0;
+    for (uint32_t s = 0; s < orbit->slot_count; ++s) {
+        Slot const *slot = orbit->slots + s;
+
+        for (uint32_t i = 0; i < slot->sticker_count; ++i) {
+            uint32_t number = orbit->sticker_count++;
+
+            orbit->stickers[number] = slot->stickers[i];
+            orbit->faces[number] = face_of_normal(slot->sticker[i].normal);
+            orbit->setups[0][number] = number;
+            solver->orbit_numbers[slot->stickers[i]] = number;
+        }
+    }
+    orbit->setup_count = 1;
+
+    solver->turn_depth_count = 0;
+    memset(solver->turn_ready, 0, sizeof(solver->turn_ready));
+}
+
+static int push_move(Solver *solver, Solution *solution, Move move) {
+    if (solution->move_count > solver->phase_start) {
+        Move *last = solution->moves + solution->move_count - 1;
+
+        if (last->face == move.face && last->depth == move.depth) {
+            last->turns = (last->turns + move.turns) % 4;
+            if (last->turns == 0) {
+                solution->move_count -= 1;
+            }
+            return 0;
+        }
+    }
+
+    if (solution->move_count == solution->move_capacity) {
+        uint32_t capacity = solution->move_capacity == 0
+                                ? INITIAL_MOVE_CAPACITY
+                                : 2 * solution->move_capacity;
+        Move *moves =
+            (Move *)realloc(solution->moves, capacity * sizeof(Move));
+
+        if (moves == NULL) {
+            return -1;
+        }
+        solution->moves = moves;
+        solution->move_capacity = capacity;
+    }
+
+    solution->moves[solution->move_count++] = move;
+    return 0;
+}
+
+// moves that cannot be expressed as a 3-cycle are applied to every sticker
+static int apply_turn(Solver *solver, Move move, Solution *solution) {
+    apply_move(solver->work, move);
+    return push_move(solver, solution, move);
+}
+
+static Cycle cycle_at(Solver const *solver, uint32_t index) {
+    return (Cycle){
+        .t = solver->templates + index % solver->template_count,
+        .setup = index / solver->template_count,
+    };
+}
+
+static inline Move setup_move(uint32_t setup) {
+    return (Move){
+        .face = (setup - 1) / 3,
+        .turns = (setup - 1) % 3 + 1,
+        .depth = 0,
+    };
+}
+
+static uint32_t cycle_stickers(Orbit const *orbit, Cycle cycle, uint32_t *from,
+                               uint32_t *to) {
+    uint8_t const *setup = orbit->setups[cycle.setup];
+
+    for (uint32_t i = 0; i < cycle.t->sticker_count; ++i) {
+        from[i] = orbit->stickers[setup[cycle.t->from[i]]];
+        to[i] = orbit->stickers[setup[cycle.t->to[i]]];
+    }
+
+    return cycle.t->sticker_count;
+}
+
+static int apply_cycle(Solver *solver, Orbit const *orbit, Cycle cycle,
+                       Solution *solution) {
+    uint32_t from[MAX_CYCLE_STICKERS];
+    uint32_t to[MAX_CYCLE_STICKERS];
+    uint32_t count = cycle_stickers(orbit, cycle, from, to);
+    int ret = 0;
+
+    permute_stickers(solver->work, from, to, count);
+
+    if (cycle.setup != 0) {
+        ret |= push_move(solver, solution, setup_move(cycle.setup));
+    }
+    for (uint32_t i = 0; i < cycle.t->move_count; ++i) {
+        ret |= push_move(solver, solution, cycle.t->moves[i]);
+    }
+    if (cycle.setup != 0) {
+        ret |= push_move(solver, solution,
+                         invert_move(setup_move(cycle.setup)));
+    }
+
+    return ret;
+}
+
+static Template *next_template(Solver *solver) {
+    DCHECK(solver->template_count < MAX_TEMPLATES, "Too many commutators\n");
+    return solver->templates + solver->template_count;
+}
+
+static uint8_t const *turn_table(Solver *solver, Orbit const *orbit,
+                                 Move move) {
+    uint32_t slot = 0;
+    uint8_t *table;
+
+    while (slot < solver->turn_depth_count &&
+           solver->turn_depths[slot] != move.depth) {
+        ++slot;
+    }
+    if (slot == solver->turn_depth_count) {
+        DCHECK(slot < MAX_TURN_DEPTHS, "Too many turn depths\n");
+        solver->turn_depths[solver->turn_depth_count++] = move.depth;
+    }
+
+    table = solver->turns[slot][move.face][move.turns - 1];
+    if (!solver->turn_ready[slot][move.face][move.turns - 1]) {
+        for (uint32_t s = 0, number = 0; s < orbit->slot_count; ++s) {
+            Slot const *orbit_slot = orbit->slots + s;
+
+            for (uint32_t i = 0; i < orbit_slot->sticker_count; ++i) {
+                Sticker moved =
+                    move_sticker(solver->sides, orbit_slot->sticker[i], move);
+
+                table[number++] =
+                    solver->orbit_numbers[index_of(solver->sides, moved)];
+            }
+        }
+        solver->turn_ready[slot][move.face][move.turns - 1] = 1;
+    }
+
+    return table;
+}
+
+// fills in the stickers cycled by `t` by tracing every sticker of the orbit
+// through the turn tables
+static int trace_template(Solver *solver, Orbit const *orbit, Template *t) {
+    uint8_t const *tables[MAX_TEMPLATE_MOVES];
+
+    for (uint32_t i = 0; i < t->move_count; ++i) {
+        tables[i] = turn_table(solver, orbit, t->moves[i]);
+    }
+
+    t->sticker_count = 0;
+    for (uint32_t number = 0; number < orbit->sticker_count; ++number) {
+        uint32_t to = number;
+
+        for (uint32_t i = 0; i < t->move_count; ++i) {
+            to = tables[i][to];
+        }
+
+        if (to == number) {
+            continue;
+        }
+        if (t->sticker_count == MAX_CYCLE_STICKERS) {
+            return -1;
+        }
+        t->from[t->sticker_count] = number;
+        t->to[t->sticker_count] = to;
+        t->sticker_count += 1;
+    }
+
+    return t->sticker_count > 0 ? 0 : -1;
+}
+
+static void add_with_inverse(Solver *solver) {
+    Template *t = solver->templates + solver->template_count++;
+    Template *inverse = next_template(solver);
+
+    inverse->move_count = t->move_count;
+    for (uint32_t i = 0; i < t->move_count; ++i) {
+        inverse->moves[i] = invert_move(t->moves[t->move_count - 1 - i]);
+    }
+    inverse->sticker_count = t->sticker_count;
+    for (uint32_t i = 0; i < t->sticker_count; ++i) {
+        inverse->from[i] = t->to[i];
+        inverse->to[i] = t->from[i];
+    }
+    solver->template_count += 1;
+}
+
+// S T S' cycles the stickers S' takes onto the ones T cycles, so conjugating
+// every template by a face turn only needs the orbit traced through the turn
+static void add_setups(Solver *solver, Orbit *orbit) {
+    uint32_t sides = solver->sides;
+
+    for (uint32_t setup = 1; setup <= SETUP_COUNT; ++setup) {
+        Move undo = invert_move(setup_move(setup));
+
+        for (uint32_t s = 0, number = 0; s < orbit->slot_count; ++s) {
+            Slot const *slot = orbit->slots + s;
+
+            for (uint32_t i = 0; i < slot->sticker_count; ++i, ++number) {
+                uint32_t undone = index_of(
+                    sides, move_sticker(sides, slot->sticker[i], undo));
+
+                orbit->setups[setup][number] = solver->orbit_numbers[undone];
+            }
+        }
+    }
+
+    orbit->setup_count = SETUP_COUNT + 1;
+}
+
+static void set_commutator(Template *t, Move const *a, uint32_t a_count,
+                           Move const *b, uint32_t b_count) {
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < a_count; ++i) {
+        t->moves[count++] = a[i];
+    }
+    for (uint32_t i = 0; i < b_count; ++i) {
+        t->moves[count++] = b[i];
+    }
+    for (uint32_t i = 0; i < a_count; ++i) {
+        t->moves[count++] = invert_move(a[a_count - 1 - i]);
+    }
+    for (uint32_t i = 0; i < b_count; ++i) {
+        t->moves[count++] = invert_move(b[b_count - 1 - i]);
+    }
+    t->move_count = count;
+}
+
+// [A, Y B Y'] where A and B are parallel inner slices and Y turns the face the
+// target sticker is on, so the two only share that one sticker. The cycle is
+// A'(x) -> x -> (Y B' Y')(x), so only three stickers need tracing
+static void center_templates(Solver *solver, Orbit const *orbit) {
+    uint32_t sides = solver->sides;
+
+    solver->template_count = 0;
+    for (uint32_t s = 0; s < orbit->slot_count; ++s) {
+        Sticker x = orbit->slots[s].sticker[0];
+        FaceColor face = orbit->faces[s];
+
+        for (uint32_t axis = 0; axis < 3; ++axis) {
+            if (axis == face_axis(face)) {
+                continue;
+            }
+
+            for (uint8_t a = 1; a <= 3; a += 2) {
+                Move y = {.face = face, .turns = a, .depth = 0};
+                Sticker turned = move_sticker(sides, x, y);
+                uint16_t a_depth = pos_layer(sides, x.pos, axis);
+                uint16_t b_depth = pos_layer(sides, turned.pos, axis);
+                uint8_t before[4];
+                uint8_t after[4];
+
+                if (a_depth == b_depth) {
+                    continue;
+                }
+
+                // where A' and Y B' Y' take x for each number of turns
+                for (uint8_t turns = 1; turns <= 3; ++turns) {
+                    Move a_undo = {axis_faces[axis], 4 - turns, a_depth};
+                    Move b_undo = {axis_faces[axis], 4 - turns, b_depth};
+                    Sticker undone = move_sticker(
+                        sides, move_sticker(sides, turned, b_undo),
+                        invert_move(y));
+
+                    before[turns] = solver->orbit_numbers[index_of(
+                        sides, move_sticker(sides, x, a_undo))];
+                    after[turns] =
+                        solver->orbit_numbers[index_of(sides, undone)];
+                }
+
+                for (uint8_t p = 1; p <= 3; ++p) {
+                    for (uint8_t q = 1; q <= 3; ++q) {
+                        Template *t = next_template(solver);
+                        Move a_moves[1] = {{axis_faces[axis], p, a_depth}};
+                        Move b_moves[3] = {
+                            y,
+                            {axis_faces[axis], q, b_depth},
+                            invert_move(y),
+                        };
+                        uint8_t cycle[3] = {before[p], s, after[q]};
+
+                        set_commutator(t, a_moves, 1, b_moves, 3);
+                        t->sticker_count = 3;
+                        for (uint32_t i = 0; i < 3; ++i) {
+                            t->from[i] = cycle[i];
+                            t->to[i] = cycle[(i + 1) % 3];
+                        }
+                        solver->template_count += 1;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// [S, Y X Y'] with S an inner slice parallel to X: Y moves one edge of X onto
+// the slice, and that edge's piece at the slice depth is the only one shared
+static void edge_templates(Solver *solver, Orbit const *orbit,
+                           uint16_t const *depths, uint32_t depth_count) {
+    solver->template_count = 0;
+    for (uint8_t x = 0; x < FC_Count; ++x) {
+        for (uint8_t y = 0; y < FC_Count; ++y) {
+            if (face_axis(x) == face_axis(y)) {
+                continue;
+            }
+
+            for (uint32_t d = 0; d < depth_count; ++d) {
+                for (uint8_t c = 1; c <= 3; ++c) {
+                    for (uint8_t a = 1; a <= 3; a += 2) {
+                        for (uint8_t b = 1; b <= 3; ++b) {
+                            Template *t = next_template(solver);
+                            Move a_moves[1] = {{x, c, depths[d]}};
+                            Move b_moves[3] = {
+                                {y, a, 0},
+                                {x, b, 0},
+                                {y, 4 - a, 0},
+                            };
+
+                            set_commutator(t, a_moves, 1, b_moves, 3);
+                            if (trace_template(solver, orbit, t) == 0) {
+                                add_with_inverse(solver);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// [X Y X', Z] with Z opposite Y: X Y X' takes one corner out of the Z layer
+static void corner_templates(Solver *solver, Orbit const *orbit) {
+    solver->template_count = 0;
+    for (uint8_t x = 0; x < FC_Count; ++x) {
+        for (uint8_t y = 0; y < FC_Count; ++y) {
+            if (face_axis(x) == face_axis(y)) {
+                continue;
+            }
+
+            for (uint8_t p = 1; p <= 3; p += 2) {
+                for (uint8_t a = 1; a <= 3; ++a) {
+                    for (uint8_t b = 1; b <= 3; ++b) {
+                        Template *t = next_template(solver);
+                        Move a_moves[3] = {
+                            {x, p, 0},
+                            {y, a, 0},
+                            {x, 4 - p, 0},
+                        };
+                        Move b_moves[1] = {
+                            {y, b, solver->sides - 1},
+                        };
+
+                        set_commutator(t, a_moves, 3, b_moves, 1);
+                        if (trace_template(solver, orbit, t) == 0) {
+                            add_with_inverse(solver);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// the number of stickers the cycle puts on their own face minus the ones it
+// takes off
+static inline int cycle_gain(FaceColor const *squares, Orbit const *orbit,
+                             Cycle cycle) {
+    uint8_t const *setup = orbit->setups[cycle.setup];
+    int gain = 0;
+
+    for (uint32_t i = 0; i < cycle.t->sticker_count; ++i) {
+        uint32_t to = setup[cycle.t->to[i]];
+        FaceColor face = orbit->faces[to];
+
+        gain += (squares[orbit->stickers[setup[cycle.t->from[i]]]] == face) -
+                (squares[orbit->stickers[to]] == face);
+    }
+
+    return gain;
+}
+
+static inline uint32_t wrong_targets(FaceColor const *squares,
+                                     Orbit const *orbit, Cycle cycle) {
+    uint8_t const *setup = orbit->setups[cycle.setup];
+    uint32_t wrong = 0;
+
+    for (uint32_t i = 0; i < cycle.t->sticker_count; ++i) {
+        uint32_t to = setup[cycle.t->to[i]];
+
+        wrong += squares[orbit->stickers[to]] != orbit->faces[to];
+    }
+
+    return wrong;
+}
+
+static int orbit_solved(FaceColor const *squares, Orbit const *orbit) {
+    for (uint32_t i = 0; i < orbit->sticker_count; ++i) {
+        if (squares[orbit->stickers[i]] != orbit->faces[i]) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// the index of the cycle in [begin, end) with the largest gain above *p_gain,
+// or -1
+static int64_t best_cycle(Solver *solver, Orbit const *orbit, uint32_t begin,
+                          uint32_t end, int *p_gain) {
+    FaceColor const *squares = get_squares(solver->work);
+    int64_t best = -1;
+
+    for (uint32_t i = begin; i < end; ++i) {
+        int gain = cycle_gain(squares, orbit, cycle_at(solver, i));
+
+        if (gain > *p_gain) {
+            *p_gain = gain;
+            best = i;
+        }
+    }
+
+    return best;
+}
+
+// Greedily applies whichever commutator fixes the most stickers, bringing in
+// the conjugated ones only once the plain ones stop helping. Twists and flips
+// of pieces already in place need two cycles, so when no single one helps the
+// pairs are searched as well, and if even that fails a random cycle among
+// the unsolved pieces is applied to get out of the dead end. Each call does a
+// bounded part of that and returns 1 once the orbit is solved
+static int orbit_step(Solver *solver, Orbit *orbit, Solution *solution) {
+    FaceColor const *squares = get_squares(solver->work);
+    uint32_t base_count = solver->base_count;
+    uint32_t count = base_count * orbit->setup_count;
+    uint32_t tried = 0;
+    int64_t first = -1;
+    int64_t second = -1;
+    int best_gain = 0;
+
+    if (orbit_solved(squares, orbit)) {
+        return 1;
+    }
+
+    if (!solver->pair_search) {
+        first = best_cycle(solver, orbit, 0, base_count, &best_gain);
+        if (first < 0 && orbit->setup_count == 1) {
+            add_setups(solver, orbit);
+            count = base_count * orbit->setup_count;
+        }
+        if (first < 0) {
+            first = best_cycle(solver, orbit, base_count, count, &best_gain);
+        }
+        if (first < 0) {
+            solver->pair_search = 1;
+            solver->pair_next = 0;
+            return 0;
+        }
+    }
+
+    for (; first < 0 && solver->pair_search && solver->pair_next < count &&
+           tried * count < PAIR_EVALS;
+         ++solver->pair_next) {
+        Cycle cycle = cycle_at(solver, solver->pair_next);
+        uint32_t from[MAX_CYCLE_STICKERS];
+        uint32_t to[MAX_CYCLE_STICKERS];
+        uint32_t sticker_count;
+        int gain;
+
+        // a useful first cycle moves at most one solved piece
+        if (3 * wrong_targets(squares, orbit, cycle) <
+            2 * cycle.t->sticker_count) {
+            continue;
+        }
+
+        tried += 1;
+        gain = best_gain - cycle_gain(squares, orbit, cycle);
+        sticker_count = cycle_stickers(orbit, cycle, from, to);
+        permute_stickers(solver->work, from, to, sticker_count);
+        second = best_cycle(solver, orbit, 0, count, &gain);
+        permute_stickers(solver->work, to, from, sticker_count);
+
+        if (second >= 0) {
+            first = solver->pair_next;
+        }
+    }
+    if (first < 0 && solver->pair_next < count) {
+        return 0;
+    }
+    solver->pair_search = 0;
+
+    // otherwise shuffle the unsolved pieces around and try again
+    if (first < 0) {
+        uint32_t start;
+
+        if (solver->kicks++ == MAX_KICKS) {
+            return -1;
+        }
+
+        solver->kick_state = solver->kick_state * 1103515245 + 12345;
+        start = (solver->kick_state >> 8) % count;
+        for (uint32_t n = 0; n < count && first < 0; ++n) {
+            uint32_t i = (start + n) % count;
+
+            if (wrong_targets(squares, orbit, cycle_at(solver, i)) >= 2) {
+                first = i;
+            }
+        }
+        if (first < 0) {
+            return -1;
+        }
+    }
+
+    if (apply_cycle(solver, orbit, cycle_at(solver, first), solution) != 0 ||
+        (second >= 0 &&
+         apply_cycle(solver, orbit, cycle_at(solver, second), solution))) {
+        return -1;
+    }
+
+    return orbit_solved(squares, orbit);
+}
+
+// the slot of the piece that belongs where the piece now in `slot` sits, or -1
+// if its stickers do not match any piece
+static int home_slot(Solver *solver, Orbit const *orbit, Slot const *slot) {
+    FaceColor const *squares = get_squares(solver->work);
+    IV3 a = face_normals[squares[slot->stickers[0]]];
+    IV3 b = face_normals[squares[slot->stickers[1]]];
+    IV3 n0 = slot->sticker[0].normal;
+    IV3 n1 = slot->sticker[1].normal;
+    IV3 ab = cross_i(a, b);
+    IV3 n01 = cross_i(n0, n1);
+    int32_t u = dot_i(n0, slot->pos);
+    int32_t v = dot_i(n1, slot->pos);
+    int32_t w = dot_i(n01, slot->pos);
+    IV3 home = {
+        a.x * u + b.x * v + ab.x * w,
+        a.y * u + b.y * v + ab.y * w,
+        a.z * u + b.z * v + ab.z * w,
+    };
+
+    if (equal_i(ab, (IV3){0, 0, 0})) {
+        return -1;
+    }
+
+    for (uint32_t s = 0; s < orbit->slot_count; ++s) {
+        if (equal_i(orbit->slots[s].pos, home)) {
+            return s;
+        }
+    }
+
+    return -1;
+}
+
+static int orbit_parity(Solver *solver, Orbit const *orbit, int *p_parity) {
+    int home[MAX_ORBIT_SLOTS];
+    uint8_t visited[MAX_ORBIT_SLOTS] = {0};
+    uint32_t cycles = 0;
+
+    for (uint32_t s = 0; s < orbit->slot_count; ++s) {
+        home[s] = home_slot(solver, orbit, orbit->slots + s);
+        if (home[s] < 0 || visited[home[s]]) {
+            return -1;
+        }
+        visited[home[s]] = 1;
+    }
+
+    memset(visited, 0, sizeof(visited));
+    for (uint32_t s = 0; s < orbit->slot_count; ++s) {
+        if (visited[s]) {
+            continue;
+        }
+        cycles += 1;
+        for (uint32_t cur = s; !visited[cur]; cur = home[cur]) {
+            visited[cur] = 1;
+        }
+    }
+
+    *p_parity = (orbit->slot_count - cycles) & 1;
+    return 0;
+}
+
+static void corner_orbit(Solver *solver, Orbit *orbit) {
+    uint32_t const layers[3] = {0, 0, 0};
+    FaceColor const faces[3] = {FC_White, FC_Red, FC_Blue};
+    uint32_t seed[3];
+    uint32_t row, col;
+
+    for (uint32_t i = 0; i < 3; ++i) {
+        get_sticker_at(solver->sides, faces[i], layers, &row, &col);
+        seed[i] = (faces[i] * solver->sides + row) * solver->sides + col;
+    }
+
+    build_orbit(solver, seed, 3, orbit);
+}
+
+// the white-red edge piece `depth` layers in from blue
+static void edge_orbit(Solver *solver, uint32_t depth, Orbit *orbit) {
+    uint32_t const layers[3] = {0, 0, depth};
+    FaceColor const faces[2] = {FC_White, FC_Red};
+    uint32_t seed[2];
+    uint32_t row, col;
+
+    for (uint32_t i = 0; i < 2; ++i) {
+        get_sticker_at(solver->sides, faces[i], layers, &row, &col);
+        seed[i] = (faces[i] * solver->sides + row) * solver->sides + col;
+    }
+
+    build_orbit(solver, seed, 2, orbit);
+}
+
+// Odd cubes first turn the middle slices until each fixed center shows its own
+// face's color; any cube orientation is at most two of these away
+static int fix_middle_centers(Solver *solver, Solution *solution) {
+    uint32_t sides = solver->sides;
+    uint32_t mid = sides / 2;
+    FaceColor const *squares = get_squares(solver->work);
+    Move options[9];
+    Move moves[MAX_CENTER_MOVES];
+
+    for (uint32_t i = 0; i < 9; ++i) {
+        options[i] = (Move){
+            .face = axis_faces[i / 3],
+            .turns = i % 3 + 1,
+            .depth = mid,
+        };
+    }
+
+    for (uint32_t length = 0; length <= MAX_CENTER_MOVES; ++length) {
+        uint32_t combos = 1;
+
+        for (uint32_t i = 0; i < length; ++i) {
+            combos *= 9;
+        }
+
+        for (uint32_t combo = 0; combo < combos; ++combo) {
+            int solved = 1;
+
+            for (uint32_t i = 0, rest = combo; i < length; ++i, rest /= 9) {
+                moves[i] = options[rest % 9];
+            }
+
+            for (uint32_t face = 0; face < FC_Count && solved; ++face) {
+                uint32_t index = (face * sides + mid) * sides + mid;
+                Sticker moved = trace_sticker(sides, sticker_of(sides, index),
+                                              moves, length);
+
+                solved = face_of_normal(moved.normal) == squares[index];
+            }
+
+            if (!solved) {
+                continue;
+            }
+            for (uint32_t i = 0; i < length; ++i) {
+                if (apply_turn(solver, moves[i], solution) != 0) {
+                    return -1;
+                }
+            }
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+// Commutators only make even permutations, so an odd corner permutation gets a
+// face turn (which also fixes the middle edges of odd cubes) and every odd wing
+// orbit gets one turn of its slice
+static int fix_parity(Solver *solver, Solution *solution) {
+    uint32_t sides = solver->sides;
+    Orbit orbit;
+    int parity;
+
+    if (sides % 2 == 1 && fix_middle_centers(solver, solution) != 0) {
+        return -1;
+    }
+
+    corner_orbit(solver, &orbit);
+    if (orbit_parity(solver, &orbit, &parity) != 0) {
+        return -1;
+    }
+    if (parity) {
+        Move turn = {.face = FC_Yellow, .turns = 1, .depth = 0};
+
+        if (apply_turn(solver, turn, solution) != 0) {
+            return -1;
+        }
+    }
+
+    for (uint32_t depth = 1; depth < sides - 1 - depth; ++depth) {
+        edge_orbit(solver, depth, &orbit);
+        if (orbit_parity(solver, &orbit, &parity) != 0) {
+            return -1;
+        }
+        if (parity) {
+            Move turn = {.face = FC_White, .turns = 1, .depth = depth};
+
+            if (apply_turn(solver, turn, solution) != 0) {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// The next center orbit with a sticker on the white face, or 0 once every
+// orbit has been handed out
+static int next_center_orbit(Solver *solver, Orbit *orbit) {
+    uint32_t sides = solver->sides;
+    uint32_t face_size = sides * sides;
+
+    for (; solver->cursor < face_size; ++solver->cursor) {
+        uint32_t seed = solver->cursor;
+        uint32_t row = seed / sides;
+        uint32_t col = seed % sides;
+
+        if (row == 0 || col == 0 || row + 1 == sides || col + 1 == sides ||
+            solver->seen[seed] || (row * 2 + 1 == sides && row == col)) {
+            continue;
+        }
+
+        build_orbit(solver, &seed, 1, orbit);
+        for (uint32_t s = 0; s < orbit->slot_count; ++s) {
+            if (orbit->slots[s].stickers[0] < face_size) {
+                solver->seen[orbit->slots[s].stickers[0]] = 1;
+            }
+        }
+
+        center_templates(solver, orbit);
+        solver->cursor += 1;
+        return 1;
+    }
+
+    return 0;
+}
+
+static int next_edge_orbit(Solver *solver, Orbit *orbit) {
+    uint32_t sides = solver->sides;
+    uint16_t depth = solver->cursor + 1;
+    uint16_t depths[2] = {depth, sides - 1 - depth};
+
+    if (depth >= sides - 1 - depth) {
+        return 0;
+    }
+
+    edge_orbit(solver, depth, orbit);
+    edge_templates(solver, orbit, depths, 2);
+    solver->cursor += 1;
+    return 1;
+}
+
+// the corners, then the middle edges of odd cubes
+static int next_three_by_three_orbit(Solver *solver, Orbit *orbit) {
+    uint16_t mid = solver->sides / 2;
+
+    switch (solver->cursor++) {
+    case 0:
+        corner_orbit(solver, orbit);
+        corner_templates(solver, orbit);
+        return 1;
+    case 1:
+        if (solver->sides % 2 == 0) {
+            return 0;
+        }
+        edge_orbit(solver, mid, orbit);
+        edge_templates(solver, orbit, &mid, 1);
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static void finish_phase(Solver *solver, Solution *solution) {
+    solution->phase_moves[solver->phase] =
+        solution->move_count - solver->phase_start;
+    solver->phase += 1;
+    solver->phase_start = solution->move_count;
+    solver->cursor = 0;
+}
+
+// One bounded piece of work: the parity fixes, setting up the next orbit or
+// one step of solving the current one
+static int solve_unit(Solver *solver, Solution *solution) {
+    typedef int (*NextOrbit)(Solver *, Orbit *);
+    static NextOrbit const next_orbit[SP_Count] = {
+        [SP_Centers] = next_center_orbit,
+        [SP_Edges] = next_edge_orbit,
+        [SP_ThreeByThree] = next_three_by_three_orbit,
+    };
+    int solved;
+
+    if (solver->phase == SP_Parity) {
+        if (fix_parity(solver, solution) != 0) {
+            return -1;
+        }
+        finish_phase(solver, solution);
+        return 0;
+    }
+
+    if (!solver->orbit_active) {
+        if (!next_orbit[solver->phase](solver, &solver->orbit)) {
+            finish_phase(solver, solution);
+            return 0;
+        }
+
+        solver->orbit_active = 1;
+        solver->base_count = solver->template_count;
+        solver->kicks = 0;
+        solver->pair_search = 0;
+        return 0;
+    }
+
+    solved = orbit_step(solver, &solver->orbit, solution);
+    if (solved < 0) {
+        return -1;
+    }
+    if (solved) {
+        solver->orbit_active = 0;
+        solver->stickers_done += solver->orbit.sticker_count;
+    }
+
+    return 0;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+Solver *new_solver(uint32_t sides) {
+    Solver *solver = (Solver *)malloc(sizeof(Solver));
+
+    DCHECK(solver != NULL, "Could not allocate solver\n");
+    *solver = (Solver){
+        .sides = sides,
+        .work = new_cube(sides),
+        .templates = (Template *)malloc(MAX_TEMPLATES * sizeof(Template)),
+        .template_count = 0,
+        .orbit_numbers = (uint8_t *)malloc(6 * sides * sides),
+        .seen = (uint8_t *)malloc(sides * sides),
+        .kick_state = 1,
+        .phase_start = 0,
+    };
+    DCHECK(solver->work != NULL && solver->templates != NULL &&
+               solver->orbit_numbers != NULL && solver->seen != NULL,
+           "Could not allocate solver for %d sides\n", sides);
+
+    init_rotations(solver->rotations);
+
+    return solver;
+}
+
+void free_solver(Solver *solver) {
+    if (solver == NULL)
+        return;
+
+    free_cube(solver->work);
+    free(solver->templates);
+    free(solver->orbit_numbers);
+    free(solver->seen);
+    free(solver);
+}
+
+void solve_begin(Solver *solver, Cube *cube, Solution *solution) {
+    DCHECK(get_side_count(cube) == solver->sides,
+           "Solver for %d sides given a cube with %d sides\n", solver->sides,
+           get_side_count(cube));
+
+    copy_cube(solver->work, cube);
+    solution->move_count = 0;
+    memset(solution->phase_moves, 0, sizeof(solution->phase_moves));
+    memset(solution->phase_seconds, 0, sizeof(solution->phase_seconds));
+    memset(solver->seen, 0, solver->sides * solver->sides);
+
+    solver->phase = solver->sides < 2 ? SP_Count : SP_Parity;
+    solver->phase_start = 0;
+    solver->cursor = 0;
+    solver->orbit_active = 0;
+    solver->stickers_done = 0;
+}
+
+SolveResult solve_step(Solver *solver, Solution *solution, double seconds) {
+    double start = now_seconds();
+    double now = start;
+
+    while (solver->phase < SP_Count && now - start < seconds) {
+        SolvePhase phase = solver->phase;
+        double unit_start = now;
+
+        if (solve_unit(solver, solution) != 0) {
+            solver->phase = SP_Count;
+            return SR_Failed;
+        }
+
+        now = now_seconds();
+        solution->phase_seconds[phase] += now - unit_start;
+    }
+
+    if (solver->phase < SP_Count) {
+        return SR_Running;
+    }
+    return is_solved(solver->work) ? SR_Solved : SR_Failed;
+}
+
+float solve_progress(Solver const *solver) {
+    uint32_t sides = solver->sides;
+    uint32_t total = FC_Count * sides * sides - (sides % 2 == 1 ? FC_Count : 0);
+
+    if (solver->phase == SP_Count || total == 0) {
+        return 1.0f;
+    }
+    return (float)solver->stickers_done / (float)total;
+}
+
+int solve_cube(Solver *solver, Cube *cube, Solution *solution) {
+    SolveResult result;
+
+    solve_begin(solver, cube, solution);
+    do {
+        result = solve_step(solver, solution, 1.0);
+    } while (result == SR_Running);
+
+    return result == SR_Solved ? 0 : -1;
+}
+
+void free_solution(Solution *solution) {
+    free(solution->moves);
+    *solution = (Solution){0};
+}
+
+void print_solution_stats(Solution const *solution) {
+    static char const *phase_names[SP_Count] = {
+        [SP_Parity] = "parity",
+        [SP_Centers] = "centers",
+        [SP_Edges] = "edges",
+        [SP_ThreeByThree] = "3x3",
+    };
+    double total = 0.0;
+
+    for (uint32_t phase = 0; phase < SP_Count; ++phase) {
+        printf("%8s: %8d moves %10.3f ms\n", phase_names[phase],
+               solution->phase_moves[phase],
+               solution->phase_seconds[phase] * 1000.0);
+        total += solution->phase_seconds[phase];
+    }
+    printf("%8s: %8d moves %10.3f ms\n", "total", solution->move_count,
+           total * 1000.0);
+}
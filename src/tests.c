@@ -1,8 +1,21 @@
 #include "tests.h"
 
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+#include "batch.h"
+#include "capture.h"
+#include "common.h"
 #include "cube.h"
+#include "frame_stats.h"
+#include "last_layer.h"
+#include "my_math.h"
+#include "solver.h"
+#include "trans_table.h"
 
 void test_1(void) {
     Cube *cube = new_cube(3);
@@ -47,3 +60,552 @@ void test_3(void) {
 
     free_cube(cube);
 }
+
+void test_last_layer(void) {
+    char const *scrambles[] = {
+        "U", "R U R' U R U2 R'", "R U R' U' R' F R2 U' R' U' R U R' F'",
+        "F R U R' U' F'", "R U' L' U R' U' L",
+    };
+    Move scramble_moves[ARR_SIZE(scrambles)][32];
+    uint32_t scramble_counts[ARR_SIZE(scrambles)];
+    uint32_t trials = 100000;
+    uint32_t solved = 0;
+    uint32_t classifications = 0;
+    LLCaseCounts counts;
+    LLClass ll_class;
+    clock_t start;
+    double seconds;
+
+    LLTable *table = new_ll_table();
+    Cube *cube = new_cube(3);
+
+    for (uint32_t i = 0; i < ARR_SIZE(scrambles); ++i) {
+        parse_moves(scrambles[i], 3, scramble_moves[i], 32,
+                    &scramble_counts[i]);
+    }
+
+    counts = ll_case_counts(table);
+    printf("%u states, %u cases, %u OLL, %u PLL, %u ZBLL, %u stored moves\n",
+           counts.states, counts.ll_cases, counts.oll_cases, counts.pll_cases,
+           counts.zbll_cases, counts.stored_moves);
+
+    srand(1);
+    for (uint32_t t = 0; t < trials; ++t) {
+        for (uint32_t i = 0; i < 8; ++i) {
+            uint32_t s = rand() % ARR_SIZE(scrambles);
+            apply_moves(cube, scramble_moves[s], scramble_counts[s]);
+        }
+
+        if (ll_classify(table, cube, &ll_class) == 0) {
+            apply_moves(cube, ll_class.algorithm, ll_class.algorithm_length);
+            solved += is_solved(cube);
+        }
+    }
+    printf("solved %u of %u last layers\n", solved, trials);
+
+    // scramble once more and time the lookup on its own
+    apply_moves(cube, scramble_moves[1], scramble_counts[1]);
+    apply_moves(cube, scramble_moves[4], scramble_counts[4]);
+
+    start = clock();
+    for (uint32_t t = 0; t < 10 * trials; ++t) {
+        classifications += ll_classify(table, cube, &ll_class) == 0;
+    }
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("%.1f million classifications per second\n",
+           classifications / seconds / 1e6);
+
+    print_moves(ll_class.algorithm, ll_class.algorithm_length);
+
+    free_cube(cube);
+    free_ll_table(table);
+}
+
+static void scramble_cube(Cube *cube, uint32_t move_count) {
+    uint32_t sides = get_side_count(cube);
+
+    for (uint32_t i = 0; i < move_count; ++i) {
+        Move move = {
+            .face = rand() % FC_Count,
+            .turns = rand() % 3 + 1,
+            .depth = rand() % sides,
+        };
+
+        apply_move(cube, move);
+    }
+}
+
+void test_solver(void) {
+    uint32_t const checked_sides[] = {2, 3, 4, 5, 6, 7, 8, 9, 12, 17};
+    uint32_t const timed_sides[] = {25, 50, 100};
+    Solution solution = {0};
+
+    srand(1);
+    for (uint32_t i = 0; i < ARR_SIZE(checked_sides); ++i) {
+        uint32_t sides = checked_sides[i];
+        Solver *solver = new_solver(sides);
+        Cube *cube = new_cube(sides);
+        uint32_t solved = 0;
+        uint32_t trials = 20;
+
+        for (uint32_t t = 0; t < trials; ++t) {
+            scramble_cube(cube, 20 * sides);
+            if (solve_cube(solver, cube, &solution) == 0) {
+                apply_moves(cube, solution.moves, solution.move_count);
+                solved += is_solved(cube);
+            }
+        }
+        printf("%3ux%-3u solved %u of %u, last took %u moves\n", sides, sides,
+               solved, trials, solution.move_count);
+
+        free_cube(cube);
+        free_solver(solver);
+    }
+
+    for (uint32_t i = 0; i < ARR_SIZE(timed_sides); ++i) {
+        uint32_t sides = timed_sides[i];
+        Solver *solver = new_solver(sides);
+        Cube *cube = new_cube(sides);
+
+        scramble_cube(cube, 20 * sides);
+        printf("%ux%u\n", sides, sides);
+        if (solve_cube(solver, cube, &solution) == 0) {
+            print_solution_stats(&solution);
+        } else {
+            printf("failed to solve\n");
+        }
+
+        free_cube(cube);
+        free_solver(solver);
+    }
+
+    free_solution(&solution);
+}
+
+typedef struct {
+    TransTable *table;
+    uint64_t key_count;
+    uint64_t seed;
+    uint32_t ops;
+    uint32_t hits;
+} TableWorker;
+
+static uint64_t bench_key(uint64_t i) {
+    i = (i + 1) * 0x9E3779B97F4A7C15ull;
+    i ^= i >> 29;
+    return i * 0xBF58476D1CE4E5B9ull;
+}
+
+// every thread picks from the same keys, so stores to a bucket race with
+// stores and probes from the other threads
+static void *table_worker(void *arg) {
+    TableWorker *worker = (TableWorker *)arg;
+    uint64_t state = worker->seed;
+    TTEntry entry;
+
+    for (uint32_t i = 0; i < worker->ops; ++i) {
+        uint64_t n;
+        uint64_t key;
+
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        n = (state >> 33) % worker->key_count;
+        key = bench_key(n);
+
+        if (i % 4 == 0) {
+            entry = (TTEntry){
+                .depth = n % 16,
+                .bound = TB_Lower,
+                .value = n & 0xFFFF,
+            };
+            tt_store(worker->table, key, entry);
+        } else if (tt_probe(worker->table, key, &entry)) {
+            // a probe must only ever see the key's own value
+            DCHECK(entry.value == (n & 0xFFFF), "Torn table entry\n");
+            worker->hits += 1;
+        }
+    }
+
+    return NULL;
+}
+
+static double wall_seconds(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void test_trans_table(void) {
+    uint32_t const thread_counts[] = {1, 2, 4, 8, 16, 32, 64};
+    uint32_t const ops = 1 << 20;
+    pthread_t threads[64];
+    TableWorker workers[64];
+    TransTable *table = new_trans_table(16 << 20);
+    Cube *cube = new_cube(3);
+    uint64_t solved_key = cube_fingerprint(cube);
+    TTEntry entry;
+
+    // a deeper entry is kept over a shallower one for the same key
+    rotate_front(cube, 0, 1);
+    DCHECK(cube_fingerprint(cube) != solved_key, "Fingerprint collision\n");
+    tt_store(table, solved_key, (TTEntry){4, TB_Exact, 20});
+    tt_store(table, solved_key, (TTEntry){2, TB_Lower, 10});
+    DCHECK(tt_probe(table, solved_key, &entry) && entry.depth == 4 &&
+               entry.bound == TB_Exact && entry.value == 20,
+           "Lost the deeper entry\n");
+    DCHECK(!tt_probe(table, cube_fingerprint(cube), &entry),
+           "Found a key that was never stored\n");
+
+    printf("%llu slots\n", (unsigned long long)trans_table_slots(table));
+    for (uint32_t i = 0; i < ARR_SIZE(thread_counts); ++i) {
+        uint32_t count = thread_counts[i];
+        uint64_t hits = 0;
+        double start;
+        double seconds;
+
+        clear_trans_table(table);
+        start = wall_seconds();
+        for (uint32_t t = 0; t < count; ++t) {
+            workers[t] = (TableWorker){
+                .table = table,
+                .key_count = trans_table_slots(table),
+                .seed = t + 1,
+                .ops = ops,
+                .hits = 0,
+            };
+            pthread_create(threads + t, NULL, table_worker, workers + t);
+        }
+        for (uint32_t t = 0; t < count; ++t) {
+            pthread_join(threads[t], NULL);
+            hits += workers[t].hits;
+        }
+        seconds = wall_seconds() - start;
+
+        printf("%2u threads: %7.1f million ops per second, %4.1f%% hits\n",
+               count, (double)count * ops / seconds / 1e6,
+               100.0 * hits / ((double)count * ops * 3 / 4));
+    }
+
+    free_cube(cube);
+    free_trans_table(table);
+}
+
+void test_batch(void) {
+    uint32_t const sides = 4;
+    uint32_t const job_count = 200;
+    BatchOptions options = {.sides = sides, .thread_count = 4};
+    Move scrambles[200][40];
+    Move solution[4096];
+    BatchStats stats;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    uint32_t solved = 0;
+    uint32_t count;
+
+    FILE *in = tmpfile();
+    FILE *out = tmpfile();
+    Cube *cube = new_cube(sides);
+    Cube *solved_cube = new_cube(sides);
+
+    srand(1);
+    for (uint32_t i = 0; i < job_count; ++i) {
+        for (uint32_t j = 0; j < 40; ++j) {
+            scrambles[i][j] = (Move){
+                .face = rand() % FC_Count,
+                .turns = rand() % 3 + 1,
+                .depth = rand() % sides,
+            };
+        }
+        write_moves(in, scrambles[i], 40);
+    }
+    fprintf(in, "not a scramble\n");
+    rewind(in);
+
+    DCHECK(run_batch(in, out, options, &stats) == 0, "Batch failed\n");
+    write_batch_stats(stdout, &stats);
+
+    // the solutions come back in input order
+    rewind(out);
+    for (uint32_t i = 0; i < job_count; ++i) {
+        copy_cube(cube, solved_cube);
+        apply_moves(cube, scrambles[i], 40);
+
+        if (getline(&line, &line_capacity, out) > 0 &&
+            parse_moves(line, sides, solution, ARR_SIZE(solution), &count) ==
+                0) {
+            apply_moves(cube, solution, count);
+            solved += is_solved(cube);
+        }
+    }
+    DCHECK(getline(&line, &line_capacity, out) > 0 &&
+               strncmp(line, "error", 5) == 0,
+           "Bad line was not reported\n");
+    printf("solved %u of %u batch jobs\n", solved, job_count);
+
+    free(line);
+    free_cube(solved_cube);
+    free_cube(cube);
+    fclose(out);
+    fclose(in);
+}
+
+// Every sticker a move changes has to be in a dirty row. The renderer uploads
+// a face's dirty rows as they are stored, cut along its texture tiles, so the
+// squares are checked in that order
+void test_dirty_rows(void) {
+    uint32_t const sides_list[] = {1, 2, 3, 4, 7};
+    uint32_t checked = 0;
+
+    srand(1);
+    for (uint32_t i = 0; i < ARR_SIZE(sides_list); ++i) {
+        uint32_t sides = sides_list[i];
+        uint32_t square_count = FC_Count * sides * sides;
+        FaceColor *before =
+            (FaceColor *)calloc(square_count, sizeof(FaceColor));
+        Cube *cube = new_cube(sides);
+
+        DCHECK(before != NULL, "Could not allocate squares\n");
+
+        for (uint32_t t = 0; t < 200; ++t) {
+            FaceColor const *after = get_squares(cube);
+            RowRange rows[FC_Count];
+
+            memcpy(before, after, square_count * sizeof(FaceColor));
+            clear_dirty_rows(cube);
+            get_dirty_rows(cube, rows);
+            for (FaceColor fc = 0; fc < FC_Count; ++fc) {
+                DCHECK(rows[fc].first > rows[fc].last,
+                       "Rows dirty right after clearing\n");
+            }
+
+            scramble_cube(cube, 1);
+
+            get_dirty_rows(cube, rows);
+            for (uint32_t j = 0; j < square_count; ++j) {
+                uint32_t fc = j / (sides * sides);
+                uint32_t row = j / sides % sides;
+
+                DCHECK(before[j] == after[j] ||
+                           (rows[fc].first <= row && row <= rows[fc].last),
+                       "%ux%u changed a sticker outside the dirty rows\n",
+                       sides, sides);
+            }
+            checked += 1;
+        }
+
+        free_cube(cube);
+        free(before);
+    }
+
+    printf("dirty rows covered the changes of %u moves\n", checked);
+}
+
+void test_visible_faces(void) {
+    // faces opposite each other in face_indices order
+    int const opposite[CUBE_FACES] = {5, 3, 4, 1, 2, 0};
+    uint32_t counts[CUBE_FACES + 1] = {0};
+
+    DCHECK(get_visible_faces(V3_of(0.0f, 0.0f, -5.0f)) == 1u << 0,
+           "Only white faces a camera straight over it\n");
+
+    srand(1);
+    for (uint32_t i = 0; i < 10000; ++i) {
+        V3 polar = {
+            .rho = 2.0f + 20.0f * rand() / (float)RAND_MAX,
+            .theta = 2.0f * PI * rand() / (float)RAND_MAX,
+            .phi = PI * rand() / (float)RAND_MAX,
+        };
+        V3 cube_center = scale3(polar_to_rectangular(polar), -1.0f);
+        uint32_t visible = get_visible_faces(cube_center);
+        uint32_t count = 0;
+
+        for (int face = 0; face < CUBE_FACES; ++face) {
+            if (visible & (1u << face)) {
+                DCHECK(!(visible & (1u << opposite[face])),
+                       "Saw face %d and its opposite\n", face);
+                count += 1;
+            }
+        }
+        DCHECK(count >= 1 && count <= 3, "Saw %u faces\n", count);
+        counts[count] += 1;
+    }
+
+    printf("visible faces: %u of one, %u of two, %u of three\n", counts[1],
+           counts[2], counts[3]);
+}
+
+static int near_enough(float a, float b) {
+    return fabsf(a - b) <= 1e-4f * (1.0f + fabsf(a) + fabsf(b));
+}
+
+void test_matrices(void) {
+    float const near_z = 2.0f;
+    float const far_z = 9.0f;
+    M4 projection = perspective(3.0f, 1.5f, near_z, far_z);
+
+    srand(1);
+    for (uint32_t i = 0; i < 1000; ++i) {
+        V3 polar = {
+            .rho = 5.0f,
+            .theta = 2.0f * PI * rand() / (float)RAND_MAX,
+            .phi = 0.1f + 2.9f * rand() / (float)RAND_MAX,
+        };
+        V3 eye = polar_to_rectangular(polar);
+        V3 forward = as_unit(scale3(eye, -1.0f));
+        V3 side = cross(forward, V3_of(0.0f, 0.0f, 1.0f));
+        V3 up = as_unit(cross(side, forward));
+        M4 view = look_at(eye, V3_of(0.0f, 0.0f, 0.0f), up);
+        M4 view_projection = mul4(projection, view);
+        M4 inverse = invert4(view_projection);
+        M4 round_trip = mul4(view_projection, inverse);
+        V3 origin = transform_point(view, V3_of(0.0f, 0.0f, 0.0f));
+        V3 point = V3_of(rand() / (float)RAND_MAX, rand() / (float)RAND_MAX,
+                         rand() / (float)RAND_MAX);
+        V3 back = transform_point(
+            inverse, transform_point(view_projection, point));
+
+        for (int col = 0; col < 4; ++col) {
+            for (int row = 0; row < 4; ++row) {
+                DCHECK(near_enough(round_trip.m[col][row],
+                                   col == row ? 1.0f : 0.0f),
+                       "Inverse was off at %d %d\n", col, row);
+            }
+        }
+
+        // the target is straight ahead, along -z
+        DCHECK(near_enough(origin.x, 0.0f) && near_enough(origin.y, 0.0f) &&
+                   near_enough(origin.z, -polar.rho),
+               "look_at put the target at %f %f %f\n", origin.x, origin.y,
+               origin.z);
+
+        for (int axis = 0; axis < 3; ++axis) {
+            DCHECK(near_enough(back.xyz[axis], point.xyz[axis]),
+                   "Point did not come back\n");
+        }
+    }
+
+    // the near and far planes go to -1 and +1 in depth
+    DCHECK(near_enough(transform_point(projection, V3_of(0, 0, -near_z)).z,
+                       -1.0f) &&
+               near_enough(
+                   transform_point(projection, V3_of(0, 0, -far_z)).z, 1.0f),
+           "Depth range was off\n");
+
+    printf("matrices agreed\n");
+}
+
+static int compare_u32(void const *a, void const *b) {
+    uint32_t x = *(uint32_t const *)a;
+    uint32_t y = *(uint32_t const *)b;
+
+    return (x > y) - (x < y);
+}
+
+void test_frame_stats(void) {
+    double const target = 1.0 / 60.0;
+    uint32_t const percents[] = {0, 50, 95, 99, 100};
+    FrameStats *stats = (FrameStats *)malloc(sizeof(FrameStats));
+    uint32_t sorted[FRAME_STATS_WINDOW];
+
+    init_frame_stats(stats, target);
+
+    // past the window, so the oldest frames have to be forgotten
+    srand(1);
+    for (uint32_t i = 0; i < 5 * FRAME_STATS_WINDOW / 2; ++i) {
+        double seconds = target * (0.5 + 1.5 * rand() / RAND_MAX);
+        uint32_t missed = 0;
+
+        record_frame(stats, seconds);
+        DCHECK(stats->count == (i < FRAME_STATS_WINDOW ? i + 1
+                                                       : FRAME_STATS_WINDOW),
+               "Window held %u frames\n", stats->count);
+
+        memcpy(sorted, stats->times_us, stats->count * sizeof(uint32_t));
+        qsort(sorted, stats->count, sizeof(uint32_t), compare_u32);
+
+        for (uint32_t j = 0; j < stats->count; ++j) {
+            missed += sorted[j] > 1.5e6 * target;
+        }
+        DCHECK(missed == stats->missed, "Counted %u missed, not %u\n",
+               stats->missed, missed);
+
+        // to the bin above the frame it should have picked
+        for (uint32_t j = 0; j < sizeof(percents) / sizeof(*percents); ++j) {
+            uint32_t expected = sorted[(stats->count - 1) * percents[j] / 100];
+            double got = frame_percentile(stats, percents[j]);
+
+            DCHECK(got * 1e6 > expected &&
+                       got * 1e6 <= expected + FRAME_STATS_BIN_US + 1,
+                   "p%u was %f, not about %u us\n", percents[j], got,
+                   expected);
+        }
+    }
+
+    write_frame_stats(stdout, stats);
+    free(stats);
+}
+
+void test_capture_writer(void) {
+    uint32_t const width = 5;
+    uint32_t const height = 3;
+    uint8_t pixels[CAPTURE_MAX_SLOTS][5 * 3 * 4];
+    CaptureWriter *writer = new_capture_writer();
+    FILE *file = tmpfile();
+    char header[32];
+    int header_size = snprintf(header, sizeof(header), "P6\n%u %u\n255\n",
+                               width, height);
+    size_t frame_size = header_size + width * height * 3;
+    uint8_t *written = (uint8_t *)malloc(CAPTURE_MAX_SLOTS * frame_size);
+
+    DCHECK(writer != NULL && file != NULL, "Couldn't start writing\n");
+
+    // every byte says which frame, row, column and channel it came from
+    for (uint32_t slot = 0; slot < CAPTURE_MAX_SLOTS; ++slot) {
+        for (uint32_t i = 0; i < width * height * 4; ++i) {
+            pixels[slot][i] = (uint8_t)(slot * 61 + i);
+        }
+        submit_capture_frame(writer, slot,
+                             (CaptureFrame){
+                                 .pixels = pixels[slot],
+                                 .width = width,
+                                 .height = height,
+                                 .file = file,
+                             });
+    }
+
+    DCHECK(finish_capture_frames(writer) == 0, "Frames weren't written\n");
+    for (uint32_t slot = 0; slot < CAPTURE_MAX_SLOTS; ++slot) {
+        DCHECK(!is_capture_slot_busy(writer, slot), "Slot %u still busy\n",
+               slot);
+    }
+
+    rewind(file);
+    DCHECK(fread(written, 1, CAPTURE_MAX_SLOTS * frame_size, file) ==
+                   CAPTURE_MAX_SLOTS * frame_size &&
+               fgetc(file) == EOF,
+           "Wrote the wrong amount\n");
+
+    // in order, top row first and without alpha
+    for (uint32_t slot = 0; slot < CAPTURE_MAX_SLOTS; ++slot) {
+        uint8_t const *frame = written + slot * frame_size;
+
+        DCHECK(memcmp(frame, header, header_size) == 0, "Bad header\n");
+        for (uint32_t y = 0; y < height; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                for (uint32_t c = 0; c < 3; ++c) {
+                    uint8_t got =
+                        frame[header_size + (y * width + x) * 3 + c];
+                    uint8_t expected =
+                        pixels[slot][((height - 1 - y) * width + x) * 4 + c];
+                    DCHECK(got == expected, "Frame %u was off at %u %u\n",
+                           slot, x, y);
+                }
+            }
+        }
+    }
+
+    free_capture_writer(writer);
+    fclose(file);
+    free(written);
+    printf("capture writer wrote %u frames\n", CAPTURE_MAX_SLOTS);
+}
@@ -0,0 +1,195 @@
+#include "trans_table.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "common.h"
+
+// one cache line of slots per bucket
+#define BUCKET_SLOTS 8
+#define HUGE_PAGE_SIZE (2u << 20)
+
+// An entry word holds the top half of the key, which the bucket index does not
+// cover, above the depth, bound and value. TB_None is never stored, so a zero
+// word is an empty slot.
+#define KEY_SHIFT 32
+#define DEPTH_SHIFT 24
+#define BOUND_SHIFT 22
+
+struct trans_table {
+    _Atomic uint64_t *slots;
+    uint64_t bucket_mask;
+    uint64_t bytes;
+};
+
+static inline uint64_t pack_entry(uint64_t key, TTEntry entry) {
+    return (key >> KEY_SHIFT << KEY_SHIFT) |
+           ((uint64_t)entry.depth << DEPTH_SHIFT) |
+           ((uint64_t)(entry.bound & 3) << BOUND_SHIFT) | entry.value;
+}
+
+static inline TTEntry unpack_entry(uint64_t word) {
+    return (TTEntry){
+        .depth = (word >> DEPTH_SHIFT) & 0xFF,
+        .bound = (word >> BOUND_SHIFT) & 3,
+        .value = word & 0xFFFF,
+    };
+}
+
+static inline int same_key(uint64_t word, uint64_t key) {
+    return word != 0 && (word >> KEY_SHIFT) == (key >> KEY_SHIFT);
+}
+
+static inline uint8_t word_depth(uint64_t word) {
+    return (word >> DEPTH_SHIFT) & 0xFF;
+}
+
+// empty slots go first, then the shallowest entries
+static inline int replaces_first(uint64_t word, uint64_t other) {
+    return other != 0 && (word == 0 || word_depth(word) < word_depth(other));
+}
+
+static inline _Atomic uint64_t *get_bucket(TransTable *table, uint64_t key) {
+    return table->slots + (key & table->bucket_mask) * BUCKET_SLOTS;
+}
+
+TransTable *new_trans_table(uint64_t bytes) {
+    uint64_t buckets = 1;
+    TransTable *table = (TransTable *)malloc(sizeof(TransTable));
+
+    DCHECK(table != NULL, "Failed to allocate transposition table\n");
+
+    while (buckets * 2 * BUCKET_SLOTS * sizeof(uint64_t) <= bytes) {
+        buckets *= 2;
+    }
+    table->bucket_mask = buckets - 1;
+    table->bytes = buckets * BUCKET_SLOTS * sizeof(uint64_t);
+
+    // One block aligned to the huge page size, so that the kernel can back the
+    // whole table with huge pages and probes miss the TLB less often
+    if (table->bytes % HUGE_PAGE_SIZE == 0) {
+        table->slots =
+            (_Atomic uint64_t *)aligned_alloc(HUGE_PAGE_SIZE, table->bytes);
+    } else {
+        table->slots = (_Atomic uint64_t *)aligned_alloc(
+            BUCKET_SLOTS * sizeof(uint64_t), table->bytes);
+    }
+    DCHECK(table->slots != NULL, "Failed to allocate %llu table bytes\n",
+           (unsigned long long)table->bytes);
+#ifdef MADV_HUGEPAGE
+    madvise((void *)table->slots, table->bytes, MADV_HUGEPAGE);
+#endif
+
+    clear_trans_table(table);
+
+    return table;
+}
+
+void free_trans_table(TransTable *table) {
+    if (table == NULL) {
+        return;
+    }
+
+    free((void *)table->slots);
+    free(table);
+}
+
+void clear_trans_table(TransTable *table) {
+    memset((void *)table->slots, 0, table->bytes);
+}
+
+uint64_t trans_table_slots(TransTable const *table) {
+    return (table->bucket_mask + 1) * BUCKET_SLOTS;
+}
+
+// Every entry is one self-contained word, so nothing else needs to be ordered
+// around the loads and stores and they can all be relaxed
+int tt_probe(TransTable *table, uint64_t key, TTEntry *p_entry) {
+    _Atomic uint64_t *bucket = get_bucket(table, key);
+
+    for (uint32_t i = 0; i < BUCKET_SLOTS; ++i) {
+        uint64_t word = atomic_load_explicit(bucket + i, memory_order_relaxed);
+
+        if (same_key(word, key)) {
+            *p_entry = unpack_entry(word);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Writes over the key's own entry, then an empty slot, then the shallowest
+// entry in the bucket, but never over an entry searched deeper than `entry`.
+// A failed compare-and-swap means another thread got to the slot first, so the
+// bucket is looked at again. Two threads storing the same new key at once can
+// both claim a slot; probes then see the first and the other ages out
+int tt_store(TransTable *table, uint64_t key, TTEntry entry) {
+    _Atomic uint64_t *bucket = get_bucket(table, key);
+    uint64_t word = pack_entry(key, entry);
+
+    DCHECK(entry.bound != TB_None, "Stored an entry without a bound\n");
+
+    for (;;) {
+        _Atomic uint64_t *victim = NULL;
+        uint64_t expected = 0;
+        int found = 0;
+
+        for (uint32_t i = 0; i < BUCKET_SLOTS && !found; ++i) {
+            uint64_t old =
+                atomic_load_explicit(bucket + i, memory_order_relaxed);
+
+            if (same_key(old, key)) {
+                victim = bucket + i;
+                expected = old;
+                found = 1;
+            } else if (victim == NULL || replaces_first(old, expected)) {
+                victim = bucket + i;
+                expected = old;
+            }
+        }
+
+        if (expected != 0 && word_depth(expected) > entry.depth) {
+            return 0;
+        }
+        if (expected == word) {
+            return 1;
+        }
+        if (atomic_compare_exchange_weak_explicit(victim, &expected, word,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+            return 1;
+        }
+    }
+}
+
+static inline uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+// Stickers fit in 3 bits, so 21 of them are folded in at a time
+uint64_t cube_fingerprint(Cube *cube) {
+    uint32_t sides = get_side_count(cube);
+    uint32_t count = FC_Count * sides * sides;
+    FaceColor const *squares = get_squares(cube);
+    uint64_t hash = mix(sides);
+
+    for (uint32_t i = 0; i < count; i += 21) {
+        uint64_t chunk = 0;
+
+        for (uint32_t j = i; j < i + 21 && j < count; ++j) {
+            chunk = (chunk << 3) | squares[j];
+        }
+        hash = mix(hash ^ chunk) + i;
+    }
+
+    return hash;
+}